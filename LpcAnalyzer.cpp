@@ -1,35 +1,27 @@
 #include "LpcAnalyzer.h"
 #include <AnalyzerHelpers.h>
+#include <algorithm>
 #include <format>
-#include <fstream>
-
-// LAD[3:1], bit0 always ignored
-enum CycleType : U8 {
-  kIoRead,
-  kIoWrite,
-  kMemRead,
-  kMemWrite,
-  kDmaRead,
-  kDmaWrite,
-};
 
-enum StartCode : U8 {
-  kStart = 0b0000,
-  kBusMasterGrant0 = 0b0010,
-  kBusMasterGrant1 = 0b0011,
-  kTpmStart = 0b0101,
-  kFwRead = 0b1101,
-  kFwWrite = 0b1110,
-  kStop = 0b1111,
+// START values behind each of the filter checkboxes
+struct StartFilter {
+  const char* title;
+  U16 start_codes;
 };
-
-enum SyncCode : U8 {
-  kReady = 0b0000,
-  kShortWait = 0b0101,
-  kLongWait = 0b0110,
-  kReadyMore = 0b1001,
-  kError = 0b1010,
+static constexpr U16 kOtherStarts =
+    (U16) ~(1 << kStart | 1 << kTpmStart | 1 << kFwRead | 1 << kFwWrite);
+static constexpr StartFilter kStartFilters[] = {
+    {"Keep LPC cycles (START 0000)", 1 << kStart},
+    {"Keep TPM cycles (START 0101)", 1 << kTpmStart},
+    {"Keep FW cycles", 1 << kFwRead | 1 << kFwWrite},
+    {"Keep other START values (bus master, Stop)", kOtherStarts},
 };
+static constexpr const char* kCycleTypeFilters[] = {
+    "Keep IO reads",  "Keep IO writes",  "Keep memory reads",
+    "Keep memory writes", "Keep DMA reads", "Keep DMA writes",
+};
+// hot addresses listed in the heatmap export
+static constexpr size_t kHeatmapTop = 100;
 
 LpcAnalyzerSettings::LpcAnalyzerSettings() {
   ClearChannels();
@@ -51,10 +43,116 @@ LpcAnalyzerSettings::LpcAnalyzerSettings() {
   AddInterface(&ui_channels_.LFRAMEn);
   AddChannel(channels_.LFRAMEn, "LFRAMEn", false);
 
-  ui_channels_.LCLK.SetTitleAndTooltip("LCLK", "Clock");
+  ui_channels_.LCLK.SetTitleAndTooltip(
+      "LCLK", "Clock. Without it, the clock is recovered from LAD/LFRAMEn.");
   ui_channels_.LCLK.SetChannel(channels_.LCLK);
+  ui_channels_.LCLK.SetSelectionOfNoneIsAllowed(true);
   AddInterface(&ui_channels_.LCLK);
   AddChannel(channels_.LCLK, "LCLK", false);
+
+  ui_lclk_khz_.SetTitleAndTooltip(
+      "LCLK frequency (kHz)",
+      "Nominal clock frequency, when there is no LCLK channel. The decoder "
+      "follows small deviations from it.");
+  ui_lclk_khz_.SetMin(1000);
+  ui_lclk_khz_.SetMax(100000);
+  ui_lclk_khz_.SetInteger(lclk_khz_);
+  AddInterface(&ui_lclk_khz_);
+
+  ui_decode_threads_.SetTitleAndTooltip(
+      "Decode threads",
+      "Cycles are decoded on this many threads. Captures are split where "
+      "LFRAMEn is asserted.");
+  ui_decode_threads_.SetMin(1);
+  ui_decode_threads_.SetMax(256);
+  ui_decode_threads_.SetInteger(decode_threads_);
+  AddInterface(&ui_decode_threads_);
+
+  ui_min_pulse_ns_.SetTitleAndTooltip(
+      "Minimum pulse width (ns)",
+      "LCLK and LFRAMEn pulses shorter than this are taken to be glitches "
+      "and ignored (0: off). Keep it under half an LCLK period, 15 ns at "
+      "33 MHz.");
+  ui_min_pulse_ns_.SetMin(0);
+  ui_min_pulse_ns_.SetMax(1000);
+  ui_min_pulse_ns_.SetInteger(min_pulse_ns_);
+  AddInterface(&ui_min_pulse_ns_);
+
+  for (size_t i = 0; i < ui_filter_starts_.size(); i++) {
+    auto& ui = ui_filter_starts_[i];
+    ui.SetTitleAndTooltip("", "Cycles with other START values are dropped "
+                              "while decoding");
+    ui.SetCheckBoxText(kStartFilters[i].title);
+    AddInterface(&ui);
+  }
+  for (size_t i = 0; i < ui_filter_cycle_types_.size(); i++) {
+    auto& ui = ui_filter_cycle_types_[i];
+    ui.SetTitleAndTooltip("", "Cycles of other types are dropped while "
+                              "decoding");
+    ui.SetCheckBoxText(kCycleTypeFilters[i]);
+    AddInterface(&ui);
+  }
+  ui_filter_addresses_.SetTitleAndTooltip(
+      "Addresses",
+      "Only keep cycles to these addresses, in hex, ranges as first-last "
+      "(e.g. 80, fed40000-fed44fff). Empty keeps all.");
+  AddInterface(&ui_filter_addresses_);
+  SetFilterInterfaces();
+
+  ui_compact_.SetTitleAndTooltip(
+      "", "Show each cycle as a single frame. Takes much less memory on long "
+          "captures; only the frames CSV export changes, to one line per "
+          "cycle.");
+  ui_compact_.SetCheckBoxText("One frame per cycle");
+  ui_compact_.SetValue(compact_);
+  AddInterface(&ui_compact_);
+
+  ui_latency_io_bits_.SetTitleAndTooltip(
+      "Latency buckets, IO",
+      "SYNC wait statistics are kept per 2^N IO ports (0: per port)");
+  ui_latency_io_bits_.SetMin(0);
+  ui_latency_io_bits_.SetMax(16);
+  ui_latency_io_bits_.SetInteger(latency_io_bits_);
+  AddInterface(&ui_latency_io_bits_);
+  ui_latency_memory_bits_.SetTitleAndTooltip(
+      "Latency buckets, memory",
+      "SYNC wait statistics are kept per 2^N bytes of memory, TPM and FW "
+      "addresses (12: per 4 KB)");
+  ui_latency_memory_bits_.SetMin(0);
+  ui_latency_memory_bits_.SetMax(32);
+  ui_latency_memory_bits_.SetInteger(latency_memory_bits_);
+  AddInterface(&ui_latency_memory_bits_);
+
+  ui_heatmap_bits_.SetTitleAndTooltip(
+      "Heatmap block size (address bits)",
+      "The access heatmap export counts per 2^N addresses (0: per "
+      "address)");
+  ui_heatmap_bits_.SetMin(0);
+  ui_heatmap_bits_.SetMax(32);
+  ui_heatmap_bits_.SetInteger(heatmap_bits_);
+  AddInterface(&ui_heatmap_bits_);
+
+  AddExportOption(kExportMergedText, "Export transactions as text");
+  AddExportExtension(kExportMergedText, "Text", "txt");
+  AddExportOption(kExportCycleCsv, "Export cycles as CSV");
+  AddExportExtension(kExportCycleCsv, "CSV", "csv");
+  AddExportOption(kExportFramesCsv, "Export frames as CSV");
+  AddExportExtension(kExportFramesCsv, "CSV", "csv");
+  AddExportOption(kExportTransactionsBinary,
+                  "Export transactions as binary columns (+ .idx)");
+  AddExportExtension(kExportTransactionsBinary, "LPC transactions", "lpctx");
+  AddExportOption(kExportRomImage, "Export reconstructed flash/ROM image");
+  AddExportExtension(kExportRomImage, "ROM image", "bin");
+  AddExportOption(kExportLatencyCsv,
+                  "Export SYNC wait / duration percentiles as CSV");
+  AddExportExtension(kExportLatencyCsv, "CSV", "csv");
+  AddExportOption(kExportHeatmapCsv,
+                  "Export access heatmap (hot addresses, regions) as CSV");
+  AddExportExtension(kExportHeatmapCsv, "CSV", "csv");
+  if constexpr (LPC_STATS) {
+    AddExportOption(kExportStats, "Export decoder statistics");
+    AddExportExtension(kExportStats, "CSV", "csv");
+  }
 }
 
 bool LpcAnalyzerSettings::SetSettingsFromInterfaces() {
@@ -76,6 +174,34 @@ bool LpcAnalyzerSettings::SetSettingsFromInterfaces() {
   }
   channels_.LFRAMEn = ui_channels_.LFRAMEn.GetChannel();
   channels_.LCLK = ui_channels_.LCLK.GetChannel();
+  lclk_khz_ = ui_lclk_khz_.GetInteger();
+  decode_threads_ = ui_decode_threads_.GetInteger();
+  min_pulse_ns_ = ui_min_pulse_ns_.GetInteger();
+
+  LpcCycleFilter filter;
+  if (!ParseAddressRanges(ui_filter_addresses_.GetText(), &filter.addresses)) {
+    SetErrorText("Addresses should be hex, like 80, fed40000-fed44fff");
+    return false;
+  }
+  filter.start_codes = 0;
+  for (size_t i = 0; i < ui_filter_starts_.size(); i++) {
+    if (ui_filter_starts_[i].GetValue()) {
+      filter.start_codes |= kStartFilters[i].start_codes;
+    }
+  }
+  // reserved cycle types don't have a checkbox
+  filter.cycle_types = (U8)(0xff << ui_filter_cycle_types_.size());
+  for (size_t i = 0; i < ui_filter_cycle_types_.size(); i++) {
+    if (ui_filter_cycle_types_[i].GetValue()) {
+      filter.cycle_types |= 1 << i;
+    }
+  }
+  filter_ = std::move(filter);
+  filter_addresses_ = ui_filter_addresses_.GetText();
+  compact_ = ui_compact_.GetValue();
+  latency_io_bits_ = ui_latency_io_bits_.GetInteger();
+  latency_memory_bits_ = ui_latency_memory_bits_.GetInteger();
+  heatmap_bits_ = ui_heatmap_bits_.GetInteger();
 
   ClearChannels();
   for (size_t i = 0; i < channels_.LAD.size(); i++) {
@@ -94,6 +220,43 @@ void LpcAnalyzerSettings::LoadSettings(const char* settings) {
   SimpleArchive archive;
   archive.SetString(settings);
   archive >> channels_;
+  // missing from settings saved by older versions
+  U32 decode_threads;
+  if (archive >> decode_threads) {
+    decode_threads_ = decode_threads;
+  }
+  U32 start_codes;
+  U32 cycle_types;
+  const char* addresses;
+  if (archive >> start_codes && archive >> cycle_types &&
+      archive >> addresses) {
+    filter_.start_codes = (U16)start_codes;
+    filter_.cycle_types = (U8)cycle_types;
+    filter_addresses_ = addresses;
+    ParseAddressRanges(addresses, &filter_.addresses);
+  }
+  U32 compact;
+  if (archive >> compact) {
+    compact_ = compact != 0;
+  }
+  U32 latency_io_bits;
+  U32 latency_memory_bits;
+  if (archive >> latency_io_bits && archive >> latency_memory_bits) {
+    latency_io_bits_ = latency_io_bits;
+    latency_memory_bits_ = latency_memory_bits;
+  }
+  U32 min_pulse_ns;
+  if (archive >> min_pulse_ns) {
+    min_pulse_ns_ = min_pulse_ns;
+  }
+  U32 lclk_khz;
+  if (archive >> lclk_khz) {
+    lclk_khz_ = lclk_khz;
+  }
+  U32 heatmap_bits;
+  if (archive >> heatmap_bits) {
+    heatmap_bits_ = heatmap_bits;
+  }
 
   ClearChannels();
   for (size_t i = 0; i < channels_.LAD.size(); i++) {
@@ -111,66 +274,60 @@ void LpcAnalyzerSettings::LoadSettings(const char* settings) {
   }
   ui_channels_.LFRAMEn.SetChannel(channels_.LFRAMEn);
   ui_channels_.LCLK.SetChannel(channels_.LCLK);
+  ui_lclk_khz_.SetInteger(lclk_khz_);
+  ui_decode_threads_.SetInteger(decode_threads_);
+  ui_min_pulse_ns_.SetInteger(min_pulse_ns_);
+  SetFilterInterfaces();
+  ui_compact_.SetValue(compact_);
+  ui_latency_io_bits_.SetInteger(latency_io_bits_);
+  ui_latency_memory_bits_.SetInteger(latency_memory_bits_);
+  ui_heatmap_bits_.SetInteger(heatmap_bits_);
 }
 
 const char* LpcAnalyzerSettings::SaveSettings() {
   SimpleArchive archive;
   archive << channels_;
+  archive << decode_threads_;
+  archive << (U32)filter_.start_codes;
+  archive << (U32)filter_.cycle_types;
+  archive << filter_addresses_.c_str();
+  archive << (U32)compact_;
+  archive << latency_io_bits_;
+  archive << latency_memory_bits_;
+  archive << min_pulse_ns_;
+  archive << lclk_khz_;
+  archive << heatmap_bits_;
   return SetReturnString(archive.GetString());
 }
 
-std::string DescribeSTART(const Frame& frame) {
-  auto start = (StartCode)frame.mData1;
-  std::string desc;
-  switch (start) {
-  case kStart:
-    desc = "Start";
-    break;
-  case kTpmStart:
-    desc = "TPM";
-    break;
-  case kFwRead:
-    desc = "FW Read";
-    break;
-  case kFwWrite:
-    desc = "FW Write";
-    break;
-  case kStop:
-    desc = "Stop";
-    break;
-  default:
-    desc = std::format("START:{:b}", (U8)start);
-    break;
+void LpcAnalyzerSettings::SetFilterInterfaces() {
+  for (size_t i = 0; i < ui_filter_starts_.size(); i++) {
+    ui_filter_starts_[i].SetValue(
+        (filter_.start_codes & kStartFilters[i].start_codes) != 0);
   }
-  return desc;
+  for (size_t i = 0; i < ui_filter_cycle_types_.size(); i++) {
+    ui_filter_cycle_types_[i].SetValue(filter_.cycle_types >> i & 1);
+  }
+  ui_filter_addresses_.SetText(filter_addresses_.c_str());
 }
-std::string DescribeCYCTYPE_DIR(const Frame& frame) {
-  auto cyctype_dir = (CycleType)frame.mData1;
-  std::string desc;
-  switch (cyctype_dir) {
-  case kIoRead:
-    desc = "IO Read";
-    break;
-  case kIoWrite:
-    desc = "IO Write";
-    break;
-  case kMemRead:
-    desc = "Mem Read";
-    break;
-  case kMemWrite:
-    desc = "Mem Write";
-    break;
-  case kDmaRead:
-    desc = "DMA Read";
-    break;
-  case kDmaWrite:
-    desc = "DMA Write";
-    break;
-  default:
-    desc = std::format("CYCTYPE_DIR:{:b}", (U8)cyctype_dir);
-    break;
+
+// |name|, or FIELD:value in binary for unknown values
+static std::string DescribeNibble(const char* name,
+                                  const char* field,
+                                  U8 value) {
+  if (name != nullptr) {
+    return name;
   }
-  return desc;
+  return std::format("{}:{:b}", field, value);
+}
+
+std::string DescribeSTART(const Frame& frame) {
+  const auto start = (U8)frame.mData1;
+  return DescribeNibble(StartName(start), "START", start);
+}
+std::string DescribeCYCTYPE_DIR(const Frame& frame) {
+  const auto cyctype = (U8)frame.mData1;
+  return DescribeNibble(CycleTypeName(cyctype), "CYCTYPE_DIR", cyctype);
 }
 std::string DescribeSIZE(const Frame& frame) {
   auto size = (U8)frame.mData1;
@@ -197,54 +354,74 @@ std::string DescribeTURN_AROUND(const Frame& frame) {
   }
   return std::format("TAR:{:b}", (U8)frame.mData1);
 }
-std::string DisplayBaseToSpecifier(DisplayBase display_base) {
+// NAME:value in |display_base|, hex for the ASCII ones. A format string per
+// base, so they're all checked and parsed at compile time.
+static std::string DescribeValue(const char* name,
+                                 U32 value,
+                                 DisplayBase display_base) {
   switch (display_base) {
   case Binary:
-    return "b";
+    return std::format("{}:{:b}", name, value);
   case Decimal:
-    return "d";
+    return std::format("{}:{:d}", name, value);
   case Hexadecimal:
   default:
-    return "x";
+    return std::format("{}:{:x}", name, value);
   }
 }
 std::string DescribeADDR(const Frame& frame, DisplayBase display_base) {
-  auto fmt =
-      std::string("ADDR:{:") + DisplayBaseToSpecifier(display_base) + "}";
-  return std::vformat(fmt, std::make_format_args((U32)frame.mData1));
+  return DescribeValue("ADDR", (U32)frame.mData1, display_base);
 }
 std::string DescribeCHANNEL(const Frame& frame) {
-  return std::format("CHANNEL:{:b}", (U8)frame.mData1);
+  // bit 3 is TC, set on the last transfer
+  auto channel = (U8)frame.mData1;
+  return std::format("CH{}{}", channel & 7, channel & 8 ? " TC" : "");
+}
+std::string DescribeIDSEL(const Frame& frame) {
+  return std::format("IDSEL:{:b}", (U8)frame.mData1);
+}
+std::string DescribeMSIZE(const Frame& frame) {
+  auto msize = (U8)frame.mData1;
+  if (msize <= 7 && (0x97 >> msize & 1)) {
+    return std::format("{}B", 1 << msize);
+  }
+  return std::format("MSIZE:{:b}", msize);
+}
+std::string DescribeTPM_MESSAGE(const Frame& frame) {
+  const auto code = (U32)frame.mData1;
+  const auto tag = (U16)(frame.mData1 >> 32);
+  const auto size = (U32)frame.mData2;
+  const auto locality = (U8)(frame.mData2 >> 32);
+  const bool response = frame.mData2 >> 40 & 1;
+  if (response) {
+    return std::format("TPM response rc:{:#x} {}B loc{}", code, size,
+                       locality);
+  }
+  // 0x8001/0x8002 are TPM 2.0 tags, 1.2 ones are 0x00c1..
+  const char* name = tag >= 0x8000 ? TpmCommandName(code) : nullptr;
+  if (name != nullptr) {
+    return std::format("TPM2_{} {}B loc{}", name, size, locality);
+  }
+  return std::format("TPM command cc:{:#x} {}B loc{}", code, size, locality);
 }
 std::string DescribeDATA(const Frame& frame, DisplayBase display_base) {
-  auto fmt =
-      std::string("DATA:{:") + DisplayBaseToSpecifier(display_base) + "}";
-  return std::vformat(fmt, std::make_format_args((U32)frame.mData1));
+  return DescribeValue("DATA", (U32)frame.mData1, display_base);
 }
 std::string DescribeSYNC(const Frame& frame) {
-  auto sync = (SyncCode)frame.mData1;
-  std::string desc;
-  switch (sync) {
-  case kReady:
-    desc = "Ready";
-    break;
-  case kShortWait:
-    desc = "ShortWait";
-    break;
-  case kLongWait:
-    desc = "LongWait";
-    break;
-  case kReadyMore:
-    desc = "ReadyMore";
-    break;
-  case kError:
-    desc = "Error";
-    break;
-  default:
-    desc = std::format("SYNC:{:b}", (U8)sync);
-    break;
-  }
-  return desc;
+  const auto sync = (U8)frame.mData1;
+  return DescribeNibble(SyncName(sync), "SYNC", sync);
+}
+
+std::string DescribeTransaction(const LpcTransaction& t,
+                                DisplayBase display_base);
+
+LpcFrame ToLpcFrame(const Frame& frame) {
+  return {(U64)frame.mStartingSampleInclusive,
+          (U64)frame.mEndingSampleInclusive,
+          frame.mData1,
+          frame.mData2,
+          (FieldType)frame.mType,
+          frame.mFlags};
 }
 
 std::string DescribeFrame(const Frame& frame, DisplayBase display_base) {
@@ -275,6 +452,19 @@ std::string DescribeFrame(const Frame& frame, DisplayBase display_base) {
   case kSYNC:
     text = DescribeSYNC(frame);
     break;
+  case kIDSEL:
+    text = DescribeIDSEL(frame);
+    break;
+  case kMSIZE:
+    text = DescribeMSIZE(frame);
+    break;
+  case kTPM_MESSAGE:
+    text = DescribeTPM_MESSAGE(frame);
+    break;
+  case kCYCLE:
+    text = DescribeTransaction(CycleFrameTransaction(ToLpcFrame(frame)),
+                               display_base);
+    break;
   }
   return text;
 }
@@ -283,124 +473,304 @@ void LpcAnalyzerResults::GenerateBubbleText(U64 frame_index,
                                             Channel& channel,
                                             DisplayBase display_base) {
   ClearResultStrings();
-  Frame f = GetFrame(frame_index);
-  std::string text = DescribeFrame(f, display_base);
-  AddResultString(text.c_str());
+  for (auto& text : FrameText(frame_index, display_base, true)) {
+    AddResultString(text.c_str());
+  }
 }
 
-void LpcAnalyzerResults::GenerateExportFile(const char* file,
-                                            DisplayBase display_base,
-                                            U32 export_type_user_id) {
-  std::ofstream file_stream(file, std::ios::out);
-
-  // Attempt to merge packets of the same type with sequential addresses
-  struct MergedPacket {
-    CycleType cyctype{};
-    U32 addr{};
-    std::vector<U8> data;
-  } merged_packet;
-
-  struct LpcPacket {
-    bool is_valid() const {
-      return cyctype.has_value() && addr.has_value() && data.has_value();
+std::vector<std::string> LpcAnalyzerResults::FrameText(
+    U64 frame_index,
+    DisplayBase display_base,
+    bool bubble) {
+  const U32 kind = (U32)display_base << 1 | (bubble ? 1 : 0);
+  {
+    std::lock_guard<std::mutex> lock(text_cache_mutex_);
+    if (auto* strings = text_cache_.Find(frame_index, kind)) {
+      return *strings;
     }
-    std::optional<CycleType> cyctype;
-    std::optional<U32> addr;
-    std::optional<U8> data;
-  };
+  }
+  std::vector<std::string> strings;
+  Frame f = GetFrame(frame_index);
+  if (bubble && f.mType == kCYCLE) {
+    // the cycle type alone when zoomed out
+    const LpcTransaction t = CycleFrameTransaction(ToLpcFrame(f));
+    const bool typed = t.cyctype != LpcTransaction::kNone;
+    Frame field{};
+    field.mType = typed ? kCYCTYPE_DIR : kSTART;
+    field.mData1 = typed ? t.cyctype : t.start_code;
+    strings.push_back(DescribeFrame(field, display_base));
+  }
+  std::string text = DescribeFrame(f, display_base);
+  std::string annotation = f.mType == kCYCLE ? CycleAnnotation(frame_index, f)
+                                             : Annotation(f);
+  // bubbles get the short one too, for when the longer one doesn't fit
+  if (bubble || annotation.empty()) {
+    strings.push_back(text);
+  }
+  if (!annotation.empty()) {
+    strings.push_back(text + ' ' + annotation);
+  }
+  std::lock_guard<std::mutex> lock(text_cache_mutex_);
+  text_cache_.Insert(frame_index, kind, strings);
+  return strings;
+}
 
-  auto write_packet = [&display_base,
-                       &file_stream](const MergedPacket& packet) {
-    Frame f;
-    f.mType = kCYCTYPE_DIR;
-    f.mData1 = packet.cyctype;
-    auto type_name = DescribeFrame(f, display_base);
-    f.mType = kADDR;
-    f.mData1 = packet.addr;
-    auto addr = DescribeFrame(f, display_base);
-    std::string data;
-    bool first = true;
-    for (auto d : packet.data) {
-      if (!first) {
-        data += ' ';
-      }
-      data += std::format("{:02x}", d);
-      first = false;
-    }
-    file_stream << type_name << ' ' << addr << " : " << data << std::endl;
-  };
+std::string LpcAnalyzerResults::Annotation(const Frame& frame) const {
+  std::string text;
+  if (frame.mType == kDATA) {
+    dissectors_.Describe(frame.mData1, frame.mData2, &text);
+  }
+  return text;
+}
 
-  LpcPacket packet;
-  const U64 num_frames = GetNumFrames();
-  for (U64 frame_index = 0; frame_index < num_frames; frame_index++) {
-    Frame f = GetFrame(frame_index);
-    FieldType ft = (FieldType)f.mType;
-    switch (ft) {
-    case kSTART:
-      packet = {};
-      break;
-    case kCYCTYPE_DIR:
-      packet.cyctype = (CycleType)f.mData1;
-      break;
-    case kADDR:
-      packet.addr = (U32)f.mData1;
-      break;
-    case kDATA:
-      packet.data = (U8)f.mData1;
-      break;
+std::string LpcAnalyzerResults::CycleAnnotation(U64 frame_index,
+                                                const Frame& frame) {
+  std::string text;
+  std::lock_guard<std::mutex> lock(mutex_);
+  // one frame per cycle, so frame indices are transaction indices
+  if (frame_index >= transactions_.size() ||
+      transactions_.start[frame_index] !=
+          (U64)frame.mStartingSampleInclusive) {
+    return text;
+  }
+  auto note = std::lower_bound(
+      notes_.begin(), notes_.end(), frame_index,
+      [](const CycleNote& n, U64 index) { return n.transaction < index; });
+  for (; note != notes_.end() && note->transaction == frame_index; ++note) {
+    std::string field;
+    if (note->type == kDATA) {
+      dissectors_.Describe(note->data1, note->data2, &field);
+    } else {
+      Frame message{};
+      message.mData1 = note->data1;
+      message.mData2 = note->data2;
+      field = DescribeTPM_MESSAGE(message);
     }
-
-    if (packet.is_valid()) {
-      if (merged_packet.data.size() == 0) {
-        merged_packet.cyctype = packet.cyctype.value();
-        merged_packet.addr = packet.addr.value();
-        merged_packet.data.push_back(packet.data.value());
-      } else if (merged_packet.cyctype == packet.cyctype &&
-                 merged_packet.addr + merged_packet.data.size() ==
-                     packet.addr) {
-        merged_packet.data.push_back(packet.data.value());
-      } else {
-        write_packet(merged_packet);
-        merged_packet.cyctype = packet.cyctype.value();
-        merged_packet.addr = packet.addr.value();
-        merged_packet.data = {};
-        merged_packet.data.push_back(packet.data.value());
+    if (!field.empty()) {
+      if (!text.empty()) {
+        text += ' ';
       }
-      packet = {};
+      text += field;
     }
+  }
+  return text;
+}
 
-    if (UpdateExportProgressAndCheckForCancel(frame_index, num_frames)) {
-      return;
+void LpcAnalyzerResults::AddCycles(const LpcFrame* frames,
+                                   const LpcCycle* cycles,
+                                   size_t num_cycles) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < num_cycles; i++) {
+    const U32 n = cycles[i].num_frames;
+    if (compact_) {
+      for (U32 f = 0; f < n; f++) {
+        if ((frames[f].type == kDATA && frames[f].data2 != 0) ||
+            frames[f].type == kTPM_MESSAGE) {
+          notes_.push_back({transactions_.size(), frames[f].data1,
+                            frames[f].data2, frames[f].type});
+        }
+      }
     }
+    transactions_.Append(cycles[i], frames, next_frame_);
+    latency_.Add(transactions_[transactions_.size() - 1]);
+    frames += n;
+    next_frame_ += compact_ ? 1 : n;
   }
+}
+
+void LpcAnalyzerResults::ClearCycles() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  transactions_.clear();
+  notes_.clear();
+  next_frame_ = 0;
+  latency_.clear();
+  dissectors_.Reset();
+  stats_ = {};
+  export_stats_ = {};
+  std::lock_guard<std::mutex> text_lock(text_cache_mutex_);
+  text_cache_.Clear();
+}
+
+void LpcAnalyzerResults::SetStats(const LpcStats& stats) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats_ = stats;
+}
 
-  // catch any trailing data
-  if (merged_packet.data.size()) {
-    write_packet(merged_packet);
+void LpcAnalyzerResults::SetLatencyBuckets(U8 io_bits,
+                                           U8 memory_bits,
+                                           U64 sample_rate) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  latency_.io_bucket_bits = io_bits;
+  latency_.memory_bucket_bits = memory_bits;
+  sample_rate_ = sample_rate;
+}
+
+void LpcAnalyzerResults::SetHeatmapBlockBits(U8 bits) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  heatmap_block_bits_ = bits;
+}
+
+void LpcAnalyzerResults::SetCompact(bool compact) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  compact_ = compact;
+}
+
+void LpcAnalyzerResults::GenerateExportFile(const char* file,
+                                            DisplayBase display_base,
+                                            U32 export_type_user_id) {
+  // the worker thread may still be adding cycles
+  std::lock_guard<std::mutex> lock(mutex_);
+  LpcStatsTimer timer(&export_stats_, kTimeExport);
+  const LpcExportSource src{
+      &transactions_, GetNumFrames(),
+      [this](U64 i) { return ToLpcFrame(GetFrame(i)); }};
+  auto progress = [this](U64 done, U64 total) {
+    return UpdateExportProgressAndCheckForCancel(done, total);
+  };
+  if (export_type_user_id == kExportTransactionsBinary) {
+    ExportTransactionsBinary(file, src, progress);
+    return;
+  }
+  if (export_type_user_id == kExportRomImage) {
+    ExportRomImage(file, src, progress);
+    return;
   }
 
-  UpdateExportProgressAndCheckForCancel(num_frames, num_frames);
+  LpcTextWriter out;
+  if (!out.Open(file)) {
+    return;
+  }
+  switch (export_type_user_id) {
+  case kExportCycleCsv:
+    ExportCycleCsv(out, src, display_base, progress);
+    break;
+  case kExportFramesCsv:
+    ExportFramesCsv(out, src, display_base, progress);
+    break;
+  case kExportLatencyCsv:
+    ExportLatencyCsv(out, latency_, (double)sample_rate_);
+    break;
+  case kExportHeatmapCsv: {
+    LpcHeatmap heatmap;
+    heatmap.block_bits = heatmap_block_bits_;
+    heatmap.Add(transactions_);
+    ExportHeatmapCsv(out, heatmap, kHeatmapTop);
+    break;
+  }
+  case kExportStats: {
+    LpcStats stats = stats_;
+    stats.Merge(export_stats_);
+    ExportStats(out, stats);
+    break;
+  }
+  case kExportMergedText:
+  default:
+    ExportMergedText(out, src, display_base, progress);
+    break;
+  }
 }
 
 void LpcAnalyzerResults::GenerateFrameTabularText(U64 frame_index,
                                                   DisplayBase display_base) {
   ClearTabularText();
-  Frame f = GetFrame(frame_index);
-  std::string text = DescribeFrame(f, display_base);
-  AddTabularText(text.c_str());
+  AddTabularText(FrameText(frame_index, display_base, false).back().c_str());
   // force a newline in the "terminal" view
   AddTabularText("");
 }
 
+std::string DescribeTransaction(const LpcTransaction& t,
+                                DisplayBase display_base) {
+  Frame f{};
+  f.mType = kSTART;
+  f.mData1 = t.start_code;
+  std::string text = DescribeFrame(f, display_base);
+  if (t.cyctype != LpcTransaction::kNone) {
+    f.mType = kCYCTYPE_DIR;
+    f.mData1 = t.cyctype;
+    text += ' ' + DescribeFrame(f, display_base);
+  }
+  if (t.has_address) {
+    f.mType = kADDR;
+    f.mData1 = t.address;
+    text += ' ' + DescribeFrame(f, display_base);
+  }
+  for (U8 i = 0; i < std::min<U8>(t.data_bytes, 4); i++) {
+    f.mType = kDATA;
+    f.mData1 = (U8)(t.data >> (i * 8));
+    text += ' ' + DescribeFrame(f, display_base);
+  }
+  if (t.data_bytes > 4) {
+    text += std::format(" (+{}B)", t.data_bytes - 4);
+  }
+  if (t.sync_waits != 0) {
+    text += std::format(" waits:{}", t.sync_waits);
+  }
+  if (t.sync != LpcTransaction::kNone && t.sync != kReady) {
+    f.mType = kSYNC;
+    f.mData1 = t.sync;
+    text += ' ' + DescribeFrame(f, display_base);
+  }
+  if (t.flags & kCycleAborted) {
+    text += " aborted";
+  }
+  return text;
+}
+
 // Never seems to be called :/
+// Every cycle is committed as one packet, so packet ids index the table.
 void LpcAnalyzerResults::GeneratePacketTabularText(U64 packet_id,
-                                                   DisplayBase display_base) {}
+                                                   DisplayBase display_base) {
+  ClearTabularText();
+  std::string text;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (packet_id >= transactions_.size()) {
+      return;
+    }
+    text = DescribeTransaction(transactions_[packet_id], display_base);
+  }
+  AddTabularText(text.c_str());
+}
+// No transactions are made out of packets, but be ready if they are.
 void LpcAnalyzerResults::GenerateTransactionTabularText(
     U64 transaction_id,
-    DisplayBase display_base) {}
+    DisplayBase display_base) {
+  GeneratePacketTabularText(transaction_id, display_base);
+}
+
+void LpcSimulationDataGenerator::Initialize(U32 sample_rate,
+                                            LpcAnalyzerSettings* settings) {
+  auto& c = settings->channels_;
+  std::array<SimulationChannelDescriptor*, 6> channels{};
+  for (size_t i = 0; i < c.LAD.size(); i++) {
+    channels[i] = channels_.Add(c.LAD[i], sample_rate, BIT_HIGH);
+  }
+  channels[4] = channels_.Add(c.LFRAMEn, sample_rate, BIT_HIGH);
+  // the clock isn't shown without a channel for it
+  if (c.LCLK != UNDEFINED_CHANNEL) {
+    channels[5] = channels_.Add(c.LCLK, sample_rate, BIT_HIGH);
+  }
+  // default mix and seed, so every run shows the same traffic
+  traffic_.emplace(LpcTrafficMix{});
+  writer_.emplace(channels, sample_rate);
+}
+
+U32 LpcSimulationDataGenerator::GenerateSimulationData(
+    U64 newest_sample_requested,
+    SimulationChannelDescriptor** simulation_channels) {
+  while (writer_->sample() < newest_sample_requested) {
+    bits_.clear();
+    traffic_->Next(&bits_);
+    writer_->Write(bits_);
+  }
+  *simulation_channels = channels_.GetArray();
+  return channels_.GetCount();
+}
 
 LpcAnalyzer::LpcAnalyzer() {
   SetAnalyzerSettings(&settings_);
+  // one "cycle" FrameV2 per cycle, see AddCycleFrameV2()
+  UseFrameV2();
 }
 
 LpcAnalyzer::~LpcAnalyzer() {
@@ -408,45 +778,60 @@ LpcAnalyzer::~LpcAnalyzer() {
 }
 
 void LpcAnalyzer::WorkerThread() {
-  auto& lframe = channels_.LFRAMEn;
-  auto& lck = channels_.LCLK;
+  LpcDecoderChannels<AnalyzerChannelData> channels;
   for (size_t i = 0; i < settings_.channels_.LAD.size(); i++) {
-    channels_.LAD[i] = GetAnalyzerChannelData(settings_.channels_.LAD[i]);
+    channels.LAD[i] = GetAnalyzerChannelData(settings_.channels_.LAD[i]);
+  }
+  channels.LFRAMEn = GetAnalyzerChannelData(settings_.channels_.LFRAMEn);
+  // null to recover the clock from the others
+  const bool clockless = settings_.channels_.LCLK == UNDEFINED_CHANNEL;
+  if (!clockless) {
+    channels.LCLK = GetAnalyzerChannelData(settings_.channels_.LCLK);
+  }
+  results_.SetLatencyBuckets((U8)settings_.latency_io_bits_,
+                             (U8)settings_.latency_memory_bits_,
+                             GetSampleRate());
+  results_.SetHeatmapBlockBits((U8)settings_.heatmap_bits_);
+  results_.SetCompact(settings_.compact_);
+  results_.ClearCycles();
+  tpm_.Reset();
+  stats_ = {};
+  const LpcCycleFilter* filter =
+      settings_.filter_.KeepsAll() ? nullptr : &settings_.filter_;
+  LpcChannelDecoder<AnalyzerChannelData> decoder(
+      channels, settings_.decode_threads_, filter);
+  const U64 min_pulse = (U64)(settings_.min_pulse_ns_ * 1e-9 * GetSampleRate());
+  decoder.SetMinPulseWidth(min_pulse);
+  if (clockless) {
+    decoder.SetClockPeriod(GetSampleRate() * 1e-3 / settings_.lclk_khz_);
+  }
+  // The index only carries over to a rerun on the same channels. Deglitching
+  // moves cycle starts too.
+  U64 index_key = (U64)GetSampleRate() * 31 + min_pulse;
+  auto add_key = [&index_key](const Channel& c) {
+    index_key = (index_key * 31 + c.mDeviceId) * 31 + c.mChannelIndex;
+  };
+  for (auto& c : settings_.channels_.LAD) {
+    add_key(c);
   }
-  lframe = GetAnalyzerChannelData(settings_.channels_.LFRAMEn);
-  lck = GetAnalyzerChannelData(settings_.channels_.LCLK);
-
+  add_key(settings_.channels_.LFRAMEn);
+  add_key(settings_.channels_.LCLK);
+  if (clockless) {
+    index_key = index_key * 31 + settings_.lclk_khz_;
+  }
+  if (index_key != cycle_index_.key()) {
+    cycle_index_.Reset(index_key);
+  }
+  decoder.UseCycleIndex(&cycle_index_,
+                        filter != nullptr ? filter->start_codes : 0xffff);
+  auto commit = [this](LpcDecoder& d) { CommitCycles(d); };
   while (true) {
-    ReportProgress(lck->GetSampleNumber());
-    auto start = NextStart();
-    if (!start.has_value()) {
-      // Does this actually need to be handled?
-      continue;
-    }
-
-    // Next LFRAMEn may occur at any time. If before end of current cycle,
-    // it means the current cycle is being aborted.
-    next_lframe_ = lframe->GetSampleOfNextEdge();
-
-    switch (start.value()) {
-    case kStart:
-    case kTpmStart:
-      ProcessTargetProtocol();
-      break;
-    case kStop:
-      // Stop cycles have one clock of inactive LFRAMEn, but we're already
-      // there.
-      break;
-    default:
-      // TODO indicate unknown cycle
-      break;
+    ReportProgress(decoder.DecodeBlock(commit));
+    if constexpr (LPC_STATS) {
+      LpcStats stats = decoder.stats();
+      stats.Merge(stats_);
+      results_.SetStats(stats);
     }
-    results_.AddMarker(lck->GetSampleNumber(),
-                       AnalyzerResults::MarkerType::Stop,
-                       settings_.channels_.LFRAMEn);
-    // why doesn't this generate a packet :(
-    results_.CommitPacketAndStartNewPacket();
-    results_.CommitResults();
   }
 }
 
@@ -455,230 +840,80 @@ void LpcAnalyzer::SetupResults() {
   results_.AddChannelBubblesWillAppearOn(settings_.channels_.LFRAMEn);
 }
 
-bool LpcAnalyzer::IsAborted() {
-  auto& lck = channels_.LCLK;
-  return lck->GetSampleOfNextEdge() >= next_lframe_;
-}
-
-bool LpcAnalyzer::AdvanceLCKToNextEdgeIfNotAborted() {
-  auto& lck = channels_.LCLK;
-  if (IsAborted()) {
-    return false;
-  }
-  lck->AdvanceToNextEdge();
-  return true;
+Frame ToFrame(const LpcFrame& frame) {
+  Frame f{};
+  f.mStartingSampleInclusive = frame.start;
+  f.mEndingSampleInclusive = frame.end;
+  f.mType = frame.type;
+  f.mData1 = frame.data1;
+  f.mData2 = frame.data2;
+  f.mFlags = frame.flags;
+  return f;
 }
 
-U8 LpcAnalyzer::SyncAndReadLAD(U64 sample_number) {
-  U8 data = 0;
-  for (size_t i = 0; i < channels_.LAD.size(); i++) {
-    auto& c = channels_.LAD[i];
-    c->AdvanceToAbsPosition(sample_number);
-    U8 b = (c->GetBitState() == BIT_HIGH) ? 1 : 0;
-    data |= b << i;
-  }
-  return data;
-}
-
-std::optional<U8> LpcAnalyzer::LADRead1() {
-  auto& lck = channels_.LCLK;
-  // Not sure how to assert/debug log and actually see the msg...
-  // Also not sure why this triggers but things seem to work fine.
-  // if (lck->GetBitState() == BIT_LOW) {
-  //  AnalyzerHelpers::Assert("LADRead1() must be called with LCK in HIGH
-  //  state");
-  //}
-  if (!AdvanceLCKToNextEdgeIfNotAborted() ||
-      !AdvanceLCKToNextEdgeIfNotAborted()) {
-    return {};
-  }
-  return SyncAndReadLAD(lck->GetSampleNumber());
-}
-
-template <typename T, NibbleEndian E, size_t N>
-std::optional<T> LpcAnalyzer::LADReadNibbles() {
-  T val = 0;
-  for (size_t i = 0; i < N; i++) {
-    std::optional<T> n_clk = LADRead1();
-    if (!n_clk.has_value()) {
-      return {};
-    }
-    T n = n_clk.value();
-    // bit of a hack to get accurate starting position of fields read using this
-    // wrapper
-    if (i == 0) {
-      data_sample_start_ = channels_.LCLK->GetSampleNumber();
-    }
-    if constexpr (E == kLSNFirst) {
-      val |= n << (i * 4);
-    } else {
-      val <<= 4;
-      val |= n;
+void LpcAnalyzer::AddCycleFrameV2(const LpcTransaction& t,
+                                  const LpcFrame* frames) {
+  FrameV2 frame;
+  const std::string start =
+      DescribeNibble(StartName(t.start_code), "START", t.start_code);
+  frame.AddString("start", start.c_str());
+  if (t.cyctype != LpcTransaction::kNone) {
+    const std::string cycle =
+        DescribeNibble(CycleTypeName(t.cyctype), "CYCTYPE_DIR", t.cyctype);
+    frame.AddString("cycle", cycle.c_str());
+  }
+  if (t.has_address) {
+    frame.AddInteger("address", t.address);
+  }
+  // all of them, the transaction only has the first 4
+  std::array<U8, 256> data;
+  size_t num_data = 0;
+  for (U32 i = 0; i < t.num_frames; i++) {
+    if (frames[i].type == kDATA && num_data < data.size()) {
+      data[num_data++] = (U8)frames[i].data1;
     }
   }
-  return val;
-}
-
-bool LpcAnalyzer::AddFrame(FieldType field,
-                           U64 start,
-                           U64 end,
-                           U64 data1,
-                           U64 data2,
-                           U8 flags) {
-  if (start == 0) {
-    start = data_sample_start_;
-  }
-  if (end == 0) {
-    // just fudge with the next (rising) clock edge
-    // TODO extend to next falling edge?
-    end = channels_.LCLK->GetSampleOfNextEdge();
-  }
-  // NOTE: end - start must be > 0 or Logic crashes when trying to zoom to the
-  // frame
-  if (start >= end) {
-    return false;
-  }
-  Frame frame{};
-  frame.mStartingSampleInclusive = start;
-  frame.mEndingSampleInclusive = end;
-  frame.mType = field;
-  frame.mData1 = data1;
-  frame.mData2 = data2;
-  frame.mFlags = flags;
-  results_.AddFrame(frame);
-  ReportProgress(frame.mEndingSampleInclusive);
-  return true;
-}
-
-template <typename T>
-bool LpcAnalyzer::AddFrameSimple(FieldType field, std::optional<T> data) {
-  if (!data.has_value()) {
-    return false;
-  }
-  return AddFrame(field, 0, 0, data.value());
-}
-
-std::optional<U8> LpcAnalyzer::NextStart() {
-  auto& lframe = channels_.LFRAMEn;
-  auto& lck = channels_.LCLK;
-
-  // Sync LCK and LFRAMEn when LFRAMEn is low/falling
-  if (lframe->GetBitState() == BIT_HIGH) {
-    lframe->AdvanceToNextEdge();
-  }
-  lck->AdvanceToAbsPosition(lframe->GetSampleNumber());
-  // Advance LFRAMEn to rising
-  lframe->AdvanceToNextEdge();
-  const auto lframe_r = lframe->GetSampleNumber();
-
-  std::optional<U8> start;
-  U64 start_sample = 0;
-  // Walk falling edges of LCK before LFRAMEn rising
-  // START is LAD[3:0] of clock *before* LFRAMEn rising
-  while (lck->GetSampleOfNextEdge() < lframe_r) {
-    lck->AdvanceToNextEdge();
-    if (lck->GetBitState() == BIT_LOW) {
-      start_sample = lck->GetSampleNumber();
-      start = SyncAndReadLAD(start_sample);
-    }
-  }
-  if (!start.has_value()) {
-    return {};
-  }
-
-  results_.AddMarker(start_sample, AnalyzerResults::Start,
-                     settings_.channels_.LFRAMEn);
-
-  // sync LCK and LFRAMEn to first LCK falling after LFRAMEn rising
-  if (lck->GetBitState() == BIT_HIGH) {
-    lck->AdvanceToNextEdge();
-  }
-  auto first_clock = lck->GetSampleNumber();
-  lframe->AdvanceToAbsPosition(first_clock);
-
-  AddFrame(kSTART, start_sample, first_clock, start.value());
-
-  // return START value
-  return start;
-}
-
-bool LpcAnalyzer::ProcessSync() {
-  auto& lck = channels_.LCLK;
-  // Each clock is a sync value, driven by whichever side is busy (slave).
-  // Eventually (the spec has timeouts, but we probably shouldn't rely on
-  // them?) a final value is driven (Ready, ReadyMore, Error) and the slave
-  // stops driving. The master drives the bus afterwards for 1 clock.
-  // Technically ReadyMore is only valid for DMA.
-  while (true) {
-    auto sync = LADRead1();
-    if (!sync.has_value()) {
-      // aborted during SYNC
-      return false;
-    }
-    AddFrame(kSYNC, lck->GetSampleNumber(), 0, sync.value());
-    if (sync == kReady || sync == kReadyMore || sync == kError) {
-      break;
-    }
+  frame.AddByteArray("data", data.data(), num_data);
+  frame.AddInteger("waits", t.sync_waits);
+  if (t.sync != LpcTransaction::kNone) {
+    const std::string sync = DescribeNibble(SyncName(t.sync), "SYNC", t.sync);
+    frame.AddString("sync", sync.c_str());
   }
-  return true;
+  frame.AddBoolean("aborted", (t.flags & kCycleAborted) != 0);
+  results_.AddFrameV2(frame, "cycle", t.start, t.end);
 }
 
-bool LpcAnalyzer::ProcessIoMemCycles(bool is_mem, bool is_write) {
-  if (is_mem) {
-    if (!AddFrameSimple(kADDR, LADReadU32MSN())) {
-      return false;
-    }
-  } else {
-    if (!AddFrameSimple(kADDR, LADReadU16MSN())) {
-      return false;
-    }
-  }
-  if (is_write) {
-    if (!AddFrameSimple(kDATA, LADReadU8LSN())) {
-      return false;
-    }
-  }
-
-  // TODO check value?
-  if (!AddFrameSimple(kTURN_AROUND, LADReadU8LSN())) {
-    return false;
-  }
-
-  if (!ProcessSync()) {
-    return false;
-  }
-
-  if (!is_write) {
-    if (!AddFrameSimple(kDATA, LADReadU8LSN())) {
-      return false;
+void LpcAnalyzer::CommitCycles(LpcDecoder& decoder) {
+  tpm_.Process(decoder);
+  results_.Dissect(decoder);
+  auto frame = decoder.frames_.begin();
+  for (auto& cycle : decoder.cycles_) {
+    const LpcFrame* cycle_frames = &*frame;
+    const LpcTransaction t = SummarizeCycle(cycle, cycle_frames, 0);
+    if (settings_.compact_) {
+      // the frame spans the cycle, no need for markers
+      results_.AddFrame(ToFrame(CycleFrame(t)));
+      frame += cycle.num_frames;
+    } else {
+      results_.AddMarker(cycle.start, AnalyzerResults::Start,
+                         settings_.channels_.LFRAMEn);
+      for (U32 i = 0; i < cycle.num_frames; i++, frame++) {
+        results_.AddFrame(ToFrame(*frame));
+      }
+      results_.AddMarker(cycle.end, AnalyzerResults::MarkerType::Stop,
+                         settings_.channels_.LFRAMEn);
     }
+    AddCycleFrameV2(t, cycle_frames);
+    // why doesn't this generate a packet :(
+    results_.CommitPacketAndStartNewPacket();
   }
-
-  if (!AddFrameSimple(kTURN_AROUND, LADReadU8LSN())) {
-    return false;
+  if (!decoder.cycles_.empty()) {
+    results_.AddCycles(decoder.frames_.data(), decoder.cycles_.data(),
+                       decoder.cycles_.size());
+    LpcStatsTimer timer(&stats_, kTimeCommitResults);
+    results_.CommitResults();
   }
-  return true;
+  // keep the frames of the cycle still in progress
+  decoder.frames_.erase(decoder.frames_.begin(), frame);
+  decoder.cycles_.clear();
 }
-
-void LpcAnalyzer::ProcessTargetProtocol() {
-  auto& lck = channels_.LCLK;
-
-  U64 sample_start = lck->GetSampleNumber();
-  U8 cyctype_data = SyncAndReadLAD(sample_start);
-  // TODO is it interesting to keep/show ignored bit?
-  CycleType cyctype_dir = (CycleType)(cyctype_data >> 1);
-  AddFrame(kCYCTYPE_DIR, sample_start, 0, cyctype_dir);
-
-  switch (cyctype_dir) {
-  case kIoRead:
-  case kIoWrite:
-  case kMemRead:
-  case kMemWrite:
-    ProcessIoMemCycles(cyctype_dir == kMemRead || cyctype_dir == kMemWrite,
-                       cyctype_dir == kIoWrite || cyctype_dir == kMemWrite);
-    break;
-  default:
-    // TODO
-    break;
-  }
-}
\ No newline at end of file
@@ -7,7 +7,18 @@
 #include <AnalyzerSettings.h>
 #include <array>
 #include <memory>
+#include <mutex>
 #include <optional>
+#include <string>
+#include <vector>
+#include "LpcChannelDecoder.h"
+#include "LpcDecoder.h"
+#include "LpcDissectors.h"
+#include "LpcExport.h"
+#include "LpcStats.h"
+#include "LpcTextCache.h"
+#include "LpcTpm.h"
+#include "LpcTraffic.h"
 
 struct LpcChannels {
   LpcChannels() {
@@ -60,9 +71,70 @@ class LpcAnalyzerSettings : public AnalyzerSettings {
 
   LpcChannels channels_;
   LpcUiChannels ui_channels_;
+
+  // nominal LCLK frequency, used when channels_.LCLK is undefined
+  U32 lclk_khz_{33333};
+  AnalyzerSettingInterfaceInteger ui_lclk_khz_;
+
+  // 1 decodes on the worker thread itself
+  U32 decode_threads_{1};
+  AnalyzerSettingInterfaceInteger ui_decode_threads_;
+
+  // LCLK/LFRAMEn glitch filter, 0 is off
+  U32 min_pulse_ns_{0};
+  AnalyzerSettingInterfaceInteger ui_min_pulse_ns_;
+
+  // Cycles not matching are dropped while decoding. The addresses are kept as
+  // typed, and parsed into filter_.
+  LpcCycleFilter filter_;
+  std::string filter_addresses_;
+  std::array<AnalyzerSettingInterfaceBool, 4> ui_filter_starts_;
+  std::array<AnalyzerSettingInterfaceBool, 6> ui_filter_cycle_types_;
+  AnalyzerSettingInterfaceText ui_filter_addresses_;
+
+  // One kCYCLE frame per cycle instead of one per field. The frames CSV
+  // export has the kCYCLE frames then, the others are the same.
+  bool compact_{};
+  AnalyzerSettingInterfaceBool ui_compact_;
+
+  // address bits dropped to bucket the latency statistics
+  U32 latency_io_bits_{0};
+  U32 latency_memory_bits_{12};
+  AnalyzerSettingInterfaceInteger ui_latency_io_bits_;
+  AnalyzerSettingInterfaceInteger ui_latency_memory_bits_;
+
+  // address bits dropped to count the heatmap export per block
+  U32 heatmap_bits_{0};
+  AnalyzerSettingInterfaceInteger ui_heatmap_bits_;
+
+ private:
+  void SetFilterInterfaces();
 };
 
 class LpcAnalyzerResults : public AnalyzerResults {
+ public:
+  LpcAnalyzerResults() { dissectors_.AddDefaults(); }
+
+  // Appends the cycles to the transaction table, for export and the packet
+  // views. Called from the worker thread, in the same order as AddFrame and
+  // CommitPacketAndStartNewPacket, so packet ids are transaction indices.
+  void AddCycles(const LpcFrame* frames,
+                 const LpcCycle* cycles,
+                 size_t num_cycles);
+  void ClearCycles();
+  // for the latency statistics, before any cycles are added
+  void SetLatencyBuckets(U8 io_bits, U8 memory_bits, U64 sample_rate);
+  void SetHeatmapBlockBits(U8 bits);
+  // Only kCYCLE frames are added, keep what CycleAnnotation() needs of the
+  // fields. Before any cycles are added.
+  void SetCompact(bool compact);
+  // decoder statistics so far, with LPC_STATS
+  void SetStats(const LpcStats& stats);
+  // Annotates DATA frames of the decoder's completed cycles, before they are
+  // committed. Worker thread only.
+  void Dissect(LpcDecoder& decoder) { dissectors_.Process(decoder); }
+
+ private:
   virtual void GenerateBubbleText(U64 frame_index,
                                   Channel& channel,
                                   DisplayBase display_base) final;
@@ -75,30 +147,56 @@ class LpcAnalyzerResults : public AnalyzerResults {
                                          DisplayBase display_base) final;
   virtual void GenerateTransactionTabularText(U64 transaction_id,
                                               DisplayBase display_base) final;
-};
 
-struct LpcAnalyzerChannels {
-  std::array<AnalyzerChannelData*, 4> LAD{};
-  AnalyzerChannelData* LFRAMEn{};
-  AnalyzerChannelData* LCLK{};
-};
+  // Bubble strings (shortest first) or the one table line for a frame,
+  // rendered once and then served from text_cache_.
+  std::vector<std::string> FrameText(U64 frame_index,
+                                     DisplayBase display_base,
+                                     bool bubble);
+  // text for a dissected DATA frame, empty if it isn't one
+  std::string Annotation(const Frame& frame) const;
+  // dissector and TPM message text from the fields of a kCYCLE frame's cycle
+  std::string CycleAnnotation(U64 frame_index, const Frame& frame);
 
-// The protocol encodes the expected format of successive fields in the START
-// and CYCTYPE fields. We explicitly type the frames.
-enum FieldType : U8 {
-  kSTART,
-  kCYCTYPE_DIR,
-  kSIZE,
-  kTURN_AROUND,
-  kADDR,
-  kCHANNEL,
-  kDATA,
-  kSYNC,
+  // a dissected DATA frame or TPM message, of a cycle shown as a kCYCLE frame
+  struct CycleNote {
+    U64 transaction;
+    U64 data1;
+    U64 data2;
+    FieldType type;
+  };
+
+  std::mutex mutex_;
+  LpcTransactionTable transactions_;
+  bool compact_{};
+  // compact mode only, in transaction order
+  std::vector<CycleNote> notes_;
+  // results frame index of the next cycle's first frame
+  U64 next_frame_{};
+  LpcLatencyStats latency_;
+  // counted when exported, from transactions_
+  U8 heatmap_block_bits_{};
+  U64 sample_rate_{};
+  LpcStats stats_;
+  LpcStats export_stats_;
+  // ranges are set up once, Describe() only needs the frame
+  LpcDissectorRegistry dissectors_;
+  // its own lock, CycleAnnotation() takes mutex_ while rendering
+  std::mutex text_cache_mutex_;
+  LpcTextCache text_cache_;
 };
 
-enum NibbleEndian {
-  kLSNFirst,
-  kMSNFirst,
+class LpcSimulationDataGenerator {
+ public:
+  void Initialize(U32 sample_rate, LpcAnalyzerSettings* settings);
+  U32 GenerateSimulationData(U64 newest_sample_requested,
+                             SimulationChannelDescriptor** simulation_channels);
+
+ private:
+  SimulationChannelDescriptorGroup channels_;
+  std::optional<LpcTrafficGenerator> traffic_;
+  std::optional<LpcSimulationWriter<SimulationChannelDescriptor>> writer_;
+  std::vector<U8> bits_;
 };
 
 class LpcAnalyzer : public Analyzer2 {
@@ -114,54 +212,39 @@ class LpcAnalyzer : public Analyzer2 {
       U64 newest_sample_requested,
       U32 sample_rate,
       SimulationChannelDescriptor** simulation_channels) final {
-    return 0;
+    if (!simulation_initialized_) {
+      simulation_.Initialize(GetSimulationSampleRate(), &settings_);
+      simulation_initialized_ = true;
+    }
+    return simulation_.GenerateSimulationData(newest_sample_requested,
+                                              simulation_channels);
   }
   // provide the sample rate required to generate good simulation data
-  virtual U32 GetMinimumSampleRateHz() final { return 0; }
+  virtual U32 GetMinimumSampleRateHz() final {
+    return kLpcSimulationMinSampleRate;
+  }
   virtual const char* GetAnalyzerName() const final { return name_; }
   virtual bool NeedsRerun() final { return false; }
 
   virtual void SetupResults() final;
 
-  bool AddFrame(FieldType field,
-                U64 start,
-                U64 end = 0,
-                U64 data1 = 0,
-                U64 data2 = 0,
-                U8 flags = 0);
-  template <typename T>
-  bool AddFrameSimple(FieldType field, std::optional<T> data);
-
-  bool IsAborted();
-  bool AdvanceLCKToNextEdgeIfNotAborted();
-
-  std::optional<U8> NextStart();
-
-  U8 SyncAndReadLAD(U64 sample_number);
-  std::optional<U8> LADRead1();
-
-  template <typename T, NibbleEndian E, size_t N>
-  std::optional<T> LADReadNibbles();
-  std::optional<U8> LADReadU8LSN() {
-    return LADReadNibbles<U8, kLSNFirst, 2>();
-  }
-  std::optional<U16> LADReadU16MSN() {
-    return LADReadNibbles<U16, kMSNFirst, 4>();
-  }
-  std::optional<U32> LADReadU32MSN() {
-    return LADReadNibbles<U32, kMSNFirst, 8>();
-  }
-
-  bool ProcessSync();
-  bool ProcessIoMemCycles(bool is_mem, bool is_write);
-  void ProcessTargetProtocol();
+  void CommitCycles(LpcDecoder& decoder);
+  // Whole cycle with named fields, for high level analyzers: start, cycle,
+  // address, data, waits, sync, aborted. |frames| are the cycle's.
+  void AddCycleFrameV2(const LpcTransaction& t, const LpcFrame* frames);
 
   static constexpr const char* name_{"LPC"};
   LpcAnalyzerSettings settings_;
   LpcAnalyzerResults results_;
-  LpcAnalyzerChannels channels_;
-  U64 data_sample_start_{};
-  U64 next_lframe_{};
+  LpcSimulationDataGenerator simulation_;
+  bool simulation_initialized_{};
+  // on the worker thread, cycles are passed to it in order when committed
+  LpcTpmReassembler tpm_;
+  // what CommitCycles() adds to the decoder's
+  LpcStats stats_;
+  // Cycle starts from earlier runs. Logic reruns on every settings change,
+  // with this the START filter can skip most of the capture.
+  LpcCycleIndex cycle_index_;
 };
 
 extern "C" {
@@ -0,0 +1,219 @@
+// Decode throughput benchmark. Runs the plugin's decode loop
+// (LpcChannelDecoder) on in-memory stand-ins for AnalyzerChannelData, filled
+// with generated traffic, so it needs neither Logic nor the SDK.
+//
+// usage: lpc_bench [options]
+//   --clocks N         LCLK clocks per capture (default 4M)
+//   --threads N        decode threads, like the plugin setting (default 1)
+//   --repeat N         runs per capture, the best one is reported (default 3)
+//
+// For every traffic mix and sample rate, prints samples/s, clocks/s,
+// cycles/s and frames/s. Built with LPC_STATS, also where the time went.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include "LpcChannelDecoder.h"
+#include "LpcTraffic.h"
+
+// Channel data kept as a list of transition samples. It is written like a
+// SimulationChannelDescriptor and read like AnalyzerChannelData. Every channel
+// starts high. Past the last transition it toggles on every sample, the way a
+// capture that is still running would eventually have more edges.
+class MockChannelData {
+ public:
+  // SimulationChannelDescriptor
+  void Advance(U32 num_samples) { write_sample_ += num_samples; }
+  void Transition() { transitions_.push_back(write_sample_); }
+
+  // AnalyzerChannelData
+  U64 GetSampleNumber() const { return sample_; }
+  BitState GetBitState() const { return high_ ? BIT_HIGH : BIT_LOW; }
+  void AdvanceToNextEdge() {
+    sample_ = next_ < transitions_.size() ? transitions_[next_++] : sample_ + 1;
+    high_ = !high_;
+  }
+  void AdvanceToAbsPosition(U64 sample) {
+    for (; next_ < transitions_.size() && transitions_[next_] <= sample;
+         next_++) {
+      high_ = !high_;
+    }
+    sample_ = sample;
+  }
+  U64 GetSampleOfNextEdge() const {
+    return next_ < transitions_.size() ? transitions_[next_] : sample_ + 1;
+  }
+  bool DoMoreTransitionsExistInCurrentData() const {
+    return next_ < transitions_.size();
+  }
+
+  void Rewind() {
+    sample_ = 0;
+    next_ = 0;
+    high_ = true;
+  }
+
+ private:
+  std::vector<U64> transitions_;
+  U64 write_sample_{};
+  U64 sample_{};
+  size_t next_{};
+  bool high_{true};
+};
+
+struct Options {
+  U64 clocks{4 << 20};
+  size_t threads{1};
+  size_t repeat{3};
+};
+
+struct Mix {
+  const char* name;
+  LpcTrafficMix mix;
+};
+
+static std::vector<Mix> Mixes() {
+  std::vector<Mix> mixes;
+  mixes.push_back({"mixed", {}});
+  Mix idle{"idle-heavy", {}};
+  idle.mix.min_idle = 64;
+  idle.mix.max_idle = 1024;
+  mixes.push_back(idle);
+  Mix sync{"sync-wait-heavy", {}};
+  sync.mix.max_sync_waits = 64;
+  mixes.push_back(sync);
+  Mix abort{"abort-heavy", {}};
+  abort.mix.abort_per_1024 = 256;
+  abort.mix.stop_per_1024 = 64;
+  mixes.push_back(abort);
+  return mixes;
+}
+
+static constexpr U64 kSampleRates[] = {kLpcSimulationMinSampleRate, 250000000,
+                                       500000000};
+
+static void Usage() {
+  std::fprintf(stderr,
+               "usage: lpc_bench [--clocks N] [--threads N] [--repeat N]\n");
+  std::exit(2);
+}
+
+static bool ParseArgs(int argc, char** argv, Options* opts) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--clocks" && has_value) {
+      opts->clocks = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--threads" && has_value) {
+      opts->threads = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--repeat" && has_value) {
+      opts->repeat = std::strtoul(argv[++i], nullptr, 10);
+    } else {
+      return false;
+    }
+  }
+  return opts->clocks > 0 && opts->repeat > 0;
+}
+
+struct Result {
+  U64 cycles{};
+  U64 frames{};
+  double secs{};
+  LpcStats stats;
+};
+
+static Result Decode(std::array<MockChannelData, 6>& data, size_t threads) {
+  LpcDecoderChannels<MockChannelData> channels;
+  for (size_t i = 0; i < channels.LAD.size(); i++) {
+    channels.LAD[i] = &data[i];
+  }
+  channels.LFRAMEn = &data[4];
+  channels.LCLK = &data[5];
+  for (auto& d : data) {
+    d.Rewind();
+  }
+
+  Result result;
+  // same bookkeeping as LpcAnalyzer::CommitCycles, minus the SDK
+  auto commit = [&](LpcDecoder& decoder) {
+    size_t frames = 0;
+    for (auto& cycle : decoder.cycles_) {
+      frames += cycle.num_frames;
+    }
+    result.cycles += decoder.cycles_.size();
+    result.frames += frames;
+    decoder.frames_.erase(decoder.frames_.begin(),
+                          decoder.frames_.begin() + frames);
+    decoder.cycles_.clear();
+  };
+  auto t0 = std::chrono::steady_clock::now();
+  LpcChannelDecoder<MockChannelData> decoder(channels, threads);
+  do {
+    decoder.DecodeBlock(commit);
+  } while (channels.LCLK->DoMoreTransitionsExistInCurrentData());
+  decoder.Finish(commit);
+  result.secs =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - t0)
+          .count();
+  result.stats = decoder.stats();
+  return result;
+}
+
+int main(int argc, char** argv) {
+  Options opts;
+  if (!ParseArgs(argc, argv, &opts)) {
+    Usage();
+  }
+
+  std::printf("%-16s %10s %10s %12s %12s %12s %12s\n", "mix", "rate MHz",
+              "clocks", "Msamples/s", "Mclocks/s", "Mcycles/s", "Mframes/s");
+  for (auto& mix : Mixes()) {
+    for (U64 rate : kSampleRates) {
+      std::array<MockChannelData, 6> data;
+      {
+        std::array<MockChannelData*, 6> channels;
+        for (size_t i = 0; i < data.size(); i++) {
+          channels[i] = &data[i];
+        }
+        LpcSimulationWriter<MockChannelData> writer(channels, rate);
+        LpcTrafficGenerator traffic(mix.mix);
+        std::vector<U8> bits;
+        U64 clocks = 0;
+        while (clocks < opts.clocks) {
+          bits.clear();
+          traffic.Next(&bits);
+          writer.Write(bits);
+          clocks += bits.size();
+        }
+        // idle at the end, the extractor reads a little past it
+        bits.assign(8, kLADMask | kLFRAMEnBit);
+        writer.Write(bits);
+        clocks += bits.size();
+
+        Result best;
+        for (size_t r = 0; r < opts.repeat; r++) {
+          Result result = Decode(data, opts.threads);
+          if (r == 0 || result.secs < best.secs) {
+            best = result;
+          }
+        }
+        const double samples = (double)writer.sample();
+        std::printf("%-16s %10.1f %10llu %12.1f %12.2f %12.3f %12.2f\n",
+                    mix.name, rate / 1e6, clocks, samples / best.secs / 1e6,
+                    clocks / best.secs / 1e6, best.cycles / best.secs / 1e6,
+                    best.frames / best.secs / 1e6);
+        if constexpr (LPC_STATS) {
+          std::printf("%16s", "");
+          for (size_t i = 0; i < kNumTimers; i++) {
+            std::printf(" %s %.1f ms", TimerName((LpcTimer)i),
+                        best.stats.ns[i] / 1e6);
+          }
+          std::printf("\n");
+        }
+      }
+    }
+  }
+  return 0;
+}
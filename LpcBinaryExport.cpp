@@ -0,0 +1,81 @@
+#include "LpcBinaryExport.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) {
+    munmap((void*)data_, size_);
+  }
+}
+
+bool MappedFile::Open(const char* path) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st {};
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  // decode is a single forward pass
+  madvise(p, st.st_size, MADV_SEQUENTIAL);
+  data_ = (const U8*)p;
+  size_ = st.st_size;
+  return true;
+}
+
+// Logic 2 binary export, digital channel, version 0:
+//   char identifier[8]  "<SALEAE>"
+//   S32 version         0
+//   S32 type            0 = digital
+//   U32 initial_state
+//   double begin_time
+//   double end_time
+//   U64 num_transitions
+//   double transition_times[num_transitions]
+static constexpr size_t kHeaderSize = 8 + 4 + 4 + 4 + 8 + 8 + 8;
+
+template <typename T>
+static T ReadAt(const U8* p, size_t offset) {
+  T val;
+  std::memcpy(&val, p + offset, sizeof(val));
+  return val;
+}
+
+bool BinaryExportChannel::Open(const char* path, std::string* error) {
+  if (!file_.Open(path)) {
+    *error = std::string(path) + ": cannot map file";
+    return false;
+  }
+  const U8* p = file_.data();
+  if (file_.size() < kHeaderSize || std::memcmp(p, "<SALEAE>", 8) != 0) {
+    *error = std::string(path) + ": not a Logic 2 binary export";
+    return false;
+  }
+  auto version = ReadAt<S32>(p, 8);
+  auto type = ReadAt<S32>(p, 12);
+  if (version != 0 || type != 0) {
+    *error = std::string(path) + ": unsupported version/type " +
+             std::to_string(version) + "/" + std::to_string(type);
+    return false;
+  }
+  initial_state_ = ReadAt<U32>(p, 16);
+  begin_time_ = ReadAt<double>(p, 20);
+  end_time_ = ReadAt<double>(p, 28);
+  num_transitions_ = ReadAt<U64>(p, 36);
+  if (num_transitions_ > (file_.size() - kHeaderSize) / sizeof(double)) {
+    *error = std::string(path) + ": truncated";
+    return false;
+  }
+  transitions_ = p + kHeaderSize;
+  return true;
+}
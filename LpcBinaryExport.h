@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include "LpcClocks.h"
+
+// Read-only mapping of a whole file.
+class MappedFile {
+ public:
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  bool Open(const char* path);
+  const U8* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const U8* data_{};
+  size_t size_{};
+};
+
+// One channel of a Logic 2 binary digital export (digital_N.bin). The
+// transition times are used straight from the mapping.
+class BinaryExportChannel {
+ public:
+  bool Open(const char* path, std::string* error);
+
+  TransitionList transitions() const {
+    return {transitions_, num_transitions_, (initial_state_ & 1) != 0};
+  }
+  // times are in seconds
+  double begin_time() const { return begin_time_; }
+  double end_time() const { return end_time_; }
+  U64 num_transitions() const { return num_transitions_; }
+  size_t size_bytes() const { return file_.size(); }
+
+ private:
+  MappedFile file_;
+  const U8* transitions_{};
+  U64 num_transitions_{};
+  U32 initial_state_{};
+  double begin_time_{};
+  double end_time_{};
+};
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include "LpcClocks.h"
+#include "LpcCycleIndex.h"
+#include "LpcDecoder.h"
+#include "LpcParallel.h"
+#include "LpcStats.h"
+
+// The plugin's decode loop minus the SDK, so it can also run against stand-in
+// channel data: extract a block of clocks, decode it (on a pool with more than
+// one thread) and hand the decoder(s) to |commit|.
+template <typename ChannelData>
+class LpcChannelDecoder {
+ public:
+  using Commit = std::function<void(LpcDecoder&)>;
+
+  // Clocks extracted per round of decoding. Results are committed after
+  // each round.
+  static constexpr size_t kClocksPerBlock = 1 << 14;
+  // Bigger blocks when decoding in parallel, to have enough to split up.
+  static constexpr size_t kParallelClocksPerBlock = 1 << 22;
+
+  // |filter| may be null, it must outlive the decoder otherwise
+  LpcChannelDecoder(const LpcDecoderChannels<ChannelData>& channels,
+                    size_t num_threads,
+                    const LpcCycleFilter* filter = nullptr)
+      : extractor_(channels, &stats_) {
+    decoder_.filter_ = filter;
+    if (num_threads > 1) {
+      parallel_.emplace(num_threads, filter);
+    }
+  }
+
+  // see ChannelClockExtractor::SetMinPulseWidth()
+  void SetMinPulseWidth(U64 samples) { extractor_.SetMinPulseWidth(samples); }
+  U64 glitches() const { return extractor_.glitches(); }
+  // see ChannelClockExtractor::SetClockPeriod()
+  void SetClockPeriod(double samples) { extractor_.SetClockPeriod(samples); }
+
+  // Cycle starts are added to |index| as clocks are extracted. Where it
+  // already covers the capture, cycles whose START isn't in |starts| (a bit
+  // per value) are skipped without extracting their clocks; they must be
+  // ones the filter drops. Not before the first clocks were found to match
+  // it though, else it is rebuilt. |index| must outlive the decoder.
+  void UseCycleIndex(LpcCycleIndex* index, U16 starts) {
+    index_ = index;
+    index_starts_ = starts;
+    index_verified_ = false;
+  }
+
+  // Decodes the next block of clocks, waiting for data if there is none yet.
+  // Returns the sample of the last clock decoded.
+  U64 DecodeBlock(const Commit& commit) {
+    U64 until = LpcCycleIndex::kNone;
+    if (index_ != nullptr && index_verified_) {
+      until = SkipUnwantedCycles();
+    }
+    size_t max_clocks = parallel_ ? kParallelClocksPerBlock : kClocksPerBlock;
+    if (index_ != nullptr && !index_verified_ &&
+        index_->covered() != LpcCycleIndex::kNone) {
+      // a small block to check the index against first
+      max_clocks = kClocksPerBlock;
+    }
+    {
+      LpcStatsTimer timer(&stats_, kTimeExtract);
+      extractor_.Extract(&clocks_, max_clocks, until);
+    }
+    if (index_ != nullptr) {
+      if (!index_verified_) {
+        const auto check = index_->Verify(clocks_);
+        if (check == LpcCycleIndex::kMismatch) {
+          // another capture
+          index_->Reset(index_->key());
+        }
+        index_verified_ = check == LpcCycleIndex::kMatch;
+      }
+      index_->AddClocks(clocks_);
+    }
+    if (parallel_) {
+      // commits happen inside, their time isn't decode time
+      const U64 commit_ns = stats_.ns[kTimeCommit];
+      {
+        LpcStatsTimer timer(&stats_, kTimeDecode);
+        parallel_->Decode(clocks_, TimedCommit(commit));
+      }
+      stats_.ns[kTimeDecode] -= stats_.ns[kTimeCommit] - commit_ns;
+    } else {
+      {
+        LpcStatsTimer timer(&stats_, kTimeDecode);
+        decoder_.Decode(clocks_);
+      }
+      TimedCommit(commit)(decoder_);
+    }
+    if (!clocks_.fall.empty()) {
+      last_sample_ = clocks_.fall.back();
+    }
+    clocks_.clear();
+    return last_sample_;
+  }
+
+  // End of data: closes the cycle in progress, if any.
+  void Finish(const Commit& commit) {
+    if (parallel_) {
+      parallel_->Finish(TimedCommit(commit));
+    } else {
+      decoder_.Finish();
+      TimedCommit(commit)(decoder_);
+    }
+  }
+
+  // Counted with LPC_STATS. Commit time is counted here, the caller may add
+  // what it does outside of DecodeBlock().
+  LpcStats& stats() { return stats_; }
+
+ private:
+  // Returns where the next unwanted cycles start, to stop extracting there.
+  U64 SkipUnwantedCycles() {
+    // only within what the index covers
+    const U64 covered = index_->covered();
+    const U64 from = last_sample_ == LpcCycleIndex::kNone ? 0 : last_sample_ + 1;
+    if (index_starts_ == 0xffff || covered == LpcCycleIndex::kNone ||
+        from > covered) {
+      return LpcCycleIndex::kNone;
+    }
+    // A cycle in progress has to see what ends it, the next start of any
+    // kind. Otherwise go to the next wanted one.
+    const bool idle = parallel_ ? parallel_->Idle() : decoder_.Idle();
+    U64 next = index_->NextStart(from, idle ? index_starts_ : 0xffff);
+    if (next == LpcCycleIndex::kNone) {
+      // nothing wanted up to where the index ends, carry on from its last
+      // cycle so it keeps growing
+      next = index_->LastStart();
+      if (next == LpcCycleIndex::kNone || next < from) {
+        return LpcCycleIndex::kNone;
+      }
+    }
+    if (next != index_->NextStart(from, 0xffff)) {
+      extractor_.Seek(next);
+    }
+    return index_->NextStart(next + 1, (U16)~index_starts_);
+  }
+
+  Commit TimedCommit(const Commit& commit) {
+    if constexpr (!LPC_STATS) {
+      return commit;
+    }
+    return [this, &commit](LpcDecoder& decoder) {
+      stats_.Take(&decoder.counts_);
+      LpcStatsTimer timer(&stats_, kTimeCommit);
+      commit(decoder);
+    };
+  }
+
+  LpcStats stats_;
+  ChannelClockExtractor<ChannelData> extractor_;
+  LpcClocks clocks_;
+  LpcDecoder decoder_;
+  std::optional<LpcParallelDecoder> parallel_;
+  LpcCycleIndex* index_{};
+  U16 index_starts_{0xffff};
+  bool index_verified_{};
+  U64 last_sample_{LpcCycleIndex::kNone};
+};
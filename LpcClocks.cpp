@@ -0,0 +1,262 @@
+#include "LpcClocks.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define LPC_AVX2_KERNEL 1
+#endif
+
+#if defined(__GNUC__)
+#define LPC_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define LPC_TARGET_AVX2
+#endif
+
+static bool CpuHasAvx2() {
+#if defined(LPC_AVX2_KERNEL) && defined(__GNUC__)
+  return __builtin_cpu_supports("avx2");
+#else
+  return false;
+#endif
+}
+
+static double TimeAt(const TransitionList& list, U64 i) {
+  double t;
+  std::memcpy(&t, list.times + i * sizeof(double), sizeof(t));
+  return t;
+}
+
+TransitionClockExtractor::TransitionClockExtractor(
+    const std::array<TransitionList, 6>& channels,
+    double origin,
+    double sample_rate,
+    U64 end_sample,
+    bool allow_simd)
+    : lclk_(channels[5]),
+      origin_(origin),
+      sample_rate_(sample_rate),
+      end_sample_(end_sample),
+      use_avx2_(allow_simd && CpuHasAvx2()) {
+  std::copy_n(channels.begin(), data_.size(), data_.begin());
+  // start on the first falling edge
+  lclk_first_ = lclk_.initial_high ? 0 : 1;
+  lclk_index_ = lclk_first_;
+}
+
+U64 TransitionClockExtractor::num_clocks() const {
+  if (lclk_.count <= lclk_first_) {
+    return 0;
+  }
+  return (lclk_.count - lclk_first_ + 1) / 2;
+}
+
+void TransitionClockExtractor::Seek(U64 clock) {
+  lclk_index_ = lclk_first_ + clock * 2;
+  if (lclk_index_ >= lclk_.count) {
+    return;
+  }
+  // skip every transition before the clock, the next Extract() takes care of
+  // those at the same time
+  const double t = TimeAt(lclk_, lclk_index_);
+  for (size_t c = 0; c < data_.size(); c++) {
+    U64 lo = 0;
+    U64 hi = data_[c].count;
+    while (lo < hi) {
+      U64 mid = lo + (hi - lo) / 2;
+      if (TimeAt(data_[c], mid) < t) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    cursor_[c] = lo;
+  }
+}
+
+U64 TransitionClockExtractor::ClockAt(U64 sample) const {
+  U64 lo = 0;
+  U64 hi = num_clocks();
+  while (lo < hi) {
+    U64 mid = lo + (hi - lo) / 2;
+    const double t = TimeAt(lclk_, lclk_first_ + mid * 2);
+    if ((U64)((t - origin_) * sample_rate_ + .5) < sample) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+void TransitionClockExtractor::SetMinPulseWidth(U64 samples) {
+  min_pulse_ = samples / sample_rate_;
+  // the AVX2 kernel takes every edge
+  use_avx2_ = use_avx2_ && samples == 0;
+}
+
+size_t TransitionClockExtractor::Extract(LpcClocks* out, size_t max_clocks) {
+  size_t n = 0;
+#ifdef LPC_AVX2_KERNEL
+  if (use_avx2_) {
+    n = ExtractAvx2(out, max_clocks);
+  }
+#endif
+  return n + ExtractScalar(out, max_clocks - n);
+}
+
+size_t TransitionClockExtractor::ExtractScalar(LpcClocks* out,
+                                               size_t max_clocks) {
+  auto to_sample = [this](double t) {
+    return (U64)((t - origin_) * sample_rate_ + .5);
+  };
+  // whether the pulse starting with transition |i| of |list| is too short
+  auto is_glitch = [this](const TransitionList& list, U64 i) {
+    return min_pulse_ > 0 && i + 1 < list.count &&
+           TimeAt(list, i + 1) - TimeAt(list, i) < min_pulse_;
+  };
+  size_t n = 0;
+  while (n < max_clocks && lclk_index_ < lclk_.count) {
+    if (is_glitch(lclk_, lclk_index_)) {
+      // LCLK stays high
+      lclk_index_ += 2;
+      glitches_++;
+      continue;
+    }
+    const double t = TimeAt(lclk_, lclk_index_);
+    U8 bits = 0;
+    for (size_t c = 0; c < data_.size(); c++) {
+      auto& d = data_[c];
+      auto& i = cursor_[c];
+      while (i < d.count && TimeAt(d, i) <= t) {
+        i++;
+      }
+      bits |= ((d.initial_high ? 1 : 0) ^ (i & 1)) << c;
+    }
+    // LFRAMEn is data_[4], if the clock lands in a short pulse it is the
+    // level around it
+    if (cursor_[4] > 0 && is_glitch(data_[4], cursor_[4] - 1)) {
+      bits ^= kLFRAMEnBit;
+      glitches_++;
+    }
+    // LCLK stays low over short high pulses
+    U64 rise_index = lclk_index_ + 1;
+    while (is_glitch(lclk_, rise_index)) {
+      rise_index += 2;
+      glitches_++;
+    }
+    U64 rise = end_sample_;
+    if (rise_index < lclk_.count) {
+      rise = to_sample(TimeAt(lclk_, rise_index));
+    }
+    out->push_back(to_sample(t), rise, bits);
+    lclk_index_ = rise_index + 1;
+    n++;
+  }
+  return n;
+}
+
+#ifdef LPC_AVX2_KERNEL
+LPC_TARGET_AVX2 size_t
+TransitionClockExtractor::ExtractAvx2(LpcClocks* out, size_t max_clocks) {
+  // Only whole pairs of clocks which have both edges, the scalar path picks up
+  // whatever is left.
+  const U64 pairs = (lclk_.count - std::min(lclk_index_, lclk_.count)) / 4;
+  const size_t n = std::min<U64>(max_clocks / 2, pairs) * 2;
+  if (n == 0) {
+    return 0;
+  }
+  const size_t base = out->size();
+  out->fall.resize(base + n);
+  out->rise.resize(base + n);
+  out->bits.resize(base + n);
+
+  const __m256d origin = _mm256_set1_pd(origin_);
+  const __m256d rate = _mm256_set1_pd(sample_rate_);
+  const __m256d half = _mm256_set1_pd(.5);
+  // adding 2^52 leaves an integer-valued double's value in the mantissa
+  const __m256d magic = _mm256_set1_pd(4503599627370496.0);
+  const __m256d inf = _mm256_set1_pd(std::numeric_limits<double>::infinity());
+  const __m256i zero = _mm256_setzero_si256();
+
+  // LAD[0..3] cursors, one per lane. Each lane gathers from the absolute
+  // address of its next transition: the lists are separate mappings, so
+  // there is no common base to take offsets from.
+  alignas(32) U64 next[4];
+  alignas(32) S64 left[4];
+  alignas(32) U64 count[4];
+  alignas(32) U64 initial[4];
+  for (size_t c = 0; c < 4; c++) {
+    next[c] = reinterpret_cast<std::uintptr_t>(data_[c].times +
+                                               cursor_[c] * sizeof(double));
+    left[c] = data_[c].count - cursor_[c];
+    count[c] = cursor_[c];
+    initial[c] = data_[c].initial_high ? 1 : 0;
+  }
+  __m256i v_next = _mm256_load_si256((const __m256i*)next);
+  __m256i v_left = _mm256_load_si256((const __m256i*)left);
+  __m256i v_count = _mm256_load_si256((const __m256i*)count);
+  const __m256i v_initial = _mm256_load_si256((const __m256i*)initial);
+
+  auto& lframe = data_[4];
+  auto& lframe_cursor = cursor_[4];
+
+  for (size_t k = 0; k < n; k += 2) {
+    // fall0 rise0 fall1 rise1
+    const __m256d t = _mm256_loadu_pd(
+        (const double*)(lclk_.times + lclk_index_ * sizeof(double)));
+    __m256d s = _mm256_add_pd(
+        _mm256_mul_pd(_mm256_sub_pd(t, origin), rate), half);
+    s = _mm256_add_pd(_mm256_floor_pd(s), magic);
+    __m256i samples = _mm256_xor_si256(_mm256_castpd_si256(s),
+                                       _mm256_castpd_si256(magic));
+    // fall0 fall1 rise0 rise1
+    samples = _mm256_permute4x64_epi64(samples, _MM_SHUFFLE(3, 1, 2, 0));
+    _mm_storeu_si128((__m128i*)&out->fall[base + k],
+                     _mm256_castsi256_si128(samples));
+    _mm_storeu_si128((__m128i*)&out->rise[base + k],
+                     _mm256_extracti128_si256(samples, 1));
+
+    for (size_t j = 0; j < 2; j++) {
+      const __m256d fall = j == 0 ? _mm256_permute4x64_pd(t, 0x00)
+                                  : _mm256_permute4x64_pd(t, 0xaa);
+      // Usually a LAD line toggles at most once per clock, so this runs
+      // once or twice.
+      while (true) {
+        const __m256i valid = _mm256_cmpgt_epi64(v_left, zero);
+        const __m256d next_time = _mm256_mask_i64gather_pd(
+            inf, nullptr, v_next, _mm256_castsi256_pd(valid), 1);
+        const __m256d passed = _mm256_cmp_pd(next_time, fall, _CMP_LE_OQ);
+        if (_mm256_testz_pd(passed, passed)) {
+          break;
+        }
+        // passed lanes are all ones, i.e. -1
+        const __m256i step = _mm256_castpd_si256(passed);
+        v_next = _mm256_sub_epi64(v_next, _mm256_slli_epi64(step, 3));
+        v_count = _mm256_sub_epi64(v_count, step);
+        v_left = _mm256_add_epi64(v_left, step);
+      }
+      const __m256i level = _mm256_slli_epi64(
+          _mm256_xor_si256(v_count, v_initial), 63);
+      U8 bits = (U8)_mm256_movemask_pd(_mm256_castsi256_pd(level));
+
+      const double fall_time = TimeAt(lclk_, lclk_index_ + j * 2);
+      while (lframe_cursor < lframe.count &&
+             TimeAt(lframe, lframe_cursor) <= fall_time) {
+        lframe_cursor++;
+      }
+      if ((lframe.initial_high ? 1 : 0) ^ (lframe_cursor & 1)) {
+        bits |= kLFRAMEnBit;
+      }
+      out->bits[base + k + j] = bits;
+    }
+    lclk_index_ += 4;
+  }
+
+  _mm256_store_si256((__m256i*)count, v_count);
+  std::copy_n(count, 4, cursor_.begin());
+  return n;
+}
+#endif
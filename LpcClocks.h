@@ -0,0 +1,369 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <vector>
+#include "LpcDecoder.h"
+#include "LpcStats.h"
+
+// LAD and LFRAMEn sampled at every LCLK falling edge, which is all the decoder
+// looks at. Extracting these in one forward pass is much cheaper than seeking
+// every channel around for each nibble.
+static constexpr U8 kLADMask = 0xf;
+static constexpr U8 kLFRAMEnBit = 1 << 4;
+
+struct LpcClocks {
+  size_t size() const { return fall.size(); }
+  void clear() {
+    fall.clear();
+    rise.clear();
+    bits.clear();
+  }
+  void push_back(U64 f, U64 r, U8 b) {
+    fall.push_back(f);
+    rise.push_back(r);
+    bits.push_back(b);
+  }
+  // First clock at or after |from| where LFRAMEn gets asserted, or size().
+  // Nothing carries over a cycle boundary, so clocks can be split here.
+  size_t NextCycleStart(size_t from) const {
+    for (size_t i = from > 0 ? from : 1; i < bits.size(); i++) {
+      if (!(bits[i] & kLFRAMEnBit) && (bits[i - 1] & kLFRAMEnBit)) {
+        return i;
+      }
+    }
+    return bits.size();
+  }
+
+  // sample of the falling edge
+  std::vector<U64> fall;
+  // sample of the rising edge following it
+  std::vector<U64> rise;
+  // LAD[3:0] | LFRAMEn << 4
+  std::vector<U8> bits;
+};
+
+// Extracts clocks by walking AnalyzerChannelData (or anything shaped like it).
+// A clock is only complete once the following rising edge is known, so the
+// last falling edge seen is held back until the next call.
+//
+// Without an LCLK channel, clocks are made up instead: LAD and LFRAMEn change
+// just after LCLK rises, so their transitions mark clock boundaries. A clock
+// of the nominal period is kept in phase (and frequency) with them, and
+// sampled half a period after each boundary. Stretches with nothing changing
+// are counted out at the current period, except that long idle ones (LFRAMEn
+// high, LAD all 1s) are skipped and the clock picks up again at the next
+// transition.
+template <typename ChannelData>
+class ChannelClockExtractor {
+ public:
+  // |stats| may be null
+  explicit ChannelClockExtractor(
+      const LpcDecoderChannels<ChannelData>& channels,
+      LpcStats* stats = nullptr)
+      : channels_(channels), stats_(stats) {}
+
+  // LCLK and LFRAMEn pulses shorter than |samples| are ignored, as if the
+  // line never changed. 0 (the default) takes every edge. Only edges with
+  // one after them in the data so far can be checked, so at the very end of
+  // a live capture one may get through.
+  void SetMinPulseWidth(U64 samples) { min_pulse_ = samples; }
+  // pulses ignored so far
+  U64 glitches() const { return glitches_; }
+
+  // Nominal LCLK period, for when channels.LCLK is null.
+  void SetClockPeriod(double samples) { nominal_period_ = period_ = samples; }
+
+  // Appends up to max_clocks clocks, stopping short of the first one falling
+  // at or after |until|. Once at least one clock was appended, returns early
+  // rather than block waiting for more data.
+  size_t Extract(LpcClocks* out, size_t max_clocks, U64 until = ~0ull) {
+    if (channels_.LCLK == nullptr) {
+      return ExtractClockless(out, max_clocks, until);
+    }
+    auto& lck = channels_.LCLK;
+    size_t n = 0;
+    U64 edges = 0;
+    const U64 glitches = glitches_;
+    while (n < max_clocks) {
+      if (n > 0 && !lck->DoMoreTransitionsExistInCurrentData()) {
+        break;
+      }
+      lck->AdvanceToNextEdge();
+      edges++;
+      const U64 sample = lck->GetSampleNumber();
+      if (IsGlitch(lck, sample)) {
+        // and the edge ending it, the clock stays where it was
+        lck->AdvanceToNextEdge();
+        edges++;
+        glitches_++;
+        continue;
+      }
+      if (lck->GetBitState() == BIT_HIGH) {
+        if (has_pending_) {
+          out->push_back(pending_fall_, sample, pending_bits_);
+          has_pending_ = false;
+          n++;
+        }
+        continue;
+      }
+      pending_fall_ = sample;
+      pending_bits_ = Sample(sample);
+      has_pending_ = true;
+      if (sample >= until) {
+        // it is the first clock next time
+        break;
+      }
+    }
+    if constexpr (LPC_STATS) {
+      if (stats_ != nullptr) {
+        stats_->Count(kCountClockEdges, edges);
+        stats_->Count(kCountAdvanceToAbsPosition, seeks_);
+        stats_->Count(kCountNextEdgeQueries, next_edge_queries_);
+        stats_->Count(kCountGlitches, glitches_ - glitches);
+      }
+      seeks_ = 0;
+      next_edge_queries_ = 0;
+    }
+    return n;
+  }
+
+  // Carries on from the first LCLK falling edge at or after |sample|, which
+  // must be ahead of what was extracted so far.
+  void Seek(U64 sample) {
+    has_pending_ = false;
+    if (channels_.LCLK != nullptr) {
+      AdvanceTo(channels_.LCLK, sample > 0 ? sample - 1 : 0);
+      return;
+    }
+    // back to before the boundary of the clock at |sample|, and lock on to
+    // the next transition
+    const U64 to = sample > 2 * period_ ? (U64)(sample - 2 * period_) : 0;
+    for (auto* c : DataChannels()) {
+      AdvanceTo(c, std::max(c->GetSampleNumber(), to));
+    }
+    locked_ = false;
+    quiet_ = 0;
+    next_edge_ = kNoEdge;
+  }
+
+ private:
+  static constexpr U64 kNoEdge = ~0ull;
+  // Loop gains, per transition, on the phase and period error. The period
+  // one is small so that edges landing a sample early or late don't throw
+  // it about; long SYNC waits are counted out with it.
+  static constexpr double kPhaseGain = 1. / 4;
+  static constexpr double kPeriodGain = 1. / 256;
+  // how far the period may be pulled off the nominal one
+  static constexpr double kMaxPeriodError = .05;
+  // idle clocks counted out before the rest of an idle stretch is skipped
+  static constexpr U32 kMaxIdleClocks = 8;
+
+  // Channel access that LPC_STATS counts. Every call goes through these.
+  void AdvanceTo(ChannelData* c, U64 sample_number) {
+    if constexpr (LPC_STATS) {
+      seeks_++;
+    }
+    c->AdvanceToAbsPosition(sample_number);
+  }
+  U64 NextEdge(ChannelData* c) {
+    if constexpr (LPC_STATS) {
+      next_edge_queries_++;
+    }
+    return c->GetSampleOfNextEdge();
+  }
+
+  std::array<ChannelData*, 5> DataChannels() const {
+    return {channels_.LAD[0], channels_.LAD[1], channels_.LAD[2],
+            channels_.LAD[3], channels_.LFRAMEn};
+  }
+
+  // First LAD/LFRAMEn transition after where they were last sampled, false
+  // if the data so far has none.
+  bool NextDataEdge(U64* edge) {
+    if (next_edge_ == kNoEdge) {
+      for (auto* c : DataChannels()) {
+        if (c->DoMoreTransitionsExistInCurrentData()) {
+          next_edge_ = std::min(next_edge_, NextEdge(c));
+        }
+      }
+    }
+    *edge = next_edge_;
+    return next_edge_ != kNoEdge;
+  }
+
+  size_t ExtractClockless(LpcClocks* out, size_t max_clocks, U64 until) {
+    size_t n = 0;
+    const U64 glitches = glitches_;
+    while (n < max_clocks) {
+      U64 edge;
+      if (!NextDataEdge(&edge)) {
+        if (n > 0) {
+          break;
+        }
+        // wait for more data
+        NextEdge(channels_.LFRAMEn);
+        continue;
+      }
+      if (!locked_) {
+        phase_ = (double)edge;
+        locked_ = true;
+      }
+      double phase = phase_;
+      double period = period_;
+      const bool transition = edge < phase + period / 2;
+      if (transition) {
+        // pull the clock towards it
+        const double error = edge - phase;
+        phase += error * kPhaseGain;
+        period = std::clamp(period + error * kPeriodGain,
+                            nominal_period_ * (1 - kMaxPeriodError),
+                            nominal_period_ * (1 + kMaxPeriodError));
+      } else if (bits_ == (kLADMask | kLFRAMEnBit) &&
+                 quiet_ >= kMaxIdleClocks) {
+        phase_ = (double)edge;
+        quiet_ = 0;
+        continue;
+      }
+      const U64 sample = (U64)(phase + period / 2);
+      if (sample >= until) {
+        break;
+      }
+      phase_ = phase;
+      period_ = period;
+      quiet_ = transition ? 0 : quiet_ + 1;
+      if (edge <= sample) {
+        bits_ = Sample(sample);
+        next_edge_ = kNoEdge;
+      }
+      out->push_back(sample, (U64)(phase_ + period_), bits_);
+      phase_ += period_;
+      n++;
+    }
+    if constexpr (LPC_STATS) {
+      if (stats_ != nullptr) {
+        stats_->Count(kCountAdvanceToAbsPosition, seeks_);
+        stats_->Count(kCountNextEdgeQueries, next_edge_queries_);
+        stats_->Count(kCountGlitches, glitches_ - glitches);
+      }
+      seeks_ = 0;
+      next_edge_queries_ = 0;
+    }
+    return n;
+  }
+
+  // Whether the level |channel| changed to at |sample| is gone again within
+  // min_pulse_.
+  bool IsGlitch(ChannelData* channel, U64 sample) {
+    return min_pulse_ > 0 && channel->DoMoreTransitionsExistInCurrentData() &&
+           NextEdge(channel) - sample < min_pulse_;
+  }
+
+  U8 Sample(U64 sample_number) {
+    U8 bits = 0;
+    for (size_t i = 0; i < channels_.LAD.size(); i++) {
+      auto& c = channels_.LAD[i];
+      AdvanceTo(c, sample_number);
+      bits |= ((c->GetBitState() == BIT_HIGH) ? 1 : 0) << i;
+    }
+    auto& lframe = channels_.LFRAMEn;
+    bool before = false;
+    U64 pulse_start = 0;
+    if (min_pulse_ > 0) {
+      // the level and first edge min_pulse_ earlier, to tell how long the
+      // pulse the clock lands in has been going
+      AdvanceTo(lframe,
+                std::max(lframe->GetSampleNumber(),
+                         sample_number > min_pulse_ ? sample_number - min_pulse_
+                                                    : 0));
+      before = lframe->GetBitState() == BIT_HIGH;
+      pulse_start = NextEdge(lframe);
+    }
+    AdvanceTo(lframe, sample_number);
+    bool high = lframe->GetBitState() == BIT_HIGH;
+    if (high != before && IsGlitch(lframe, pulse_start)) {
+      high = before;
+      glitches_++;
+    }
+    return bits | (high ? kLFRAMEnBit : 0);
+  }
+
+  LpcDecoderChannels<ChannelData> channels_;
+  LpcStats* stats_;
+  U64 min_pulse_{};
+  U64 glitches_{};
+  // with LPC_STATS, since the last Extract()
+  U64 seeks_{};
+  U64 next_edge_queries_{};
+  bool has_pending_{};
+  U64 pending_fall_{};
+  U8 pending_bits_{};
+  // clockless: period and time of the next boundary, in samples
+  double nominal_period_{};
+  double period_{};
+  double phase_{};
+  bool locked_{};
+  // clocks since the last transition
+  U32 quiet_{};
+  U64 next_edge_{kNoEdge};
+  // levels at the last clock
+  U8 bits_{kLADMask | kLFRAMEnBit};
+};
+
+// Transition times of one channel as stored in a Logic 2 binary export:
+// doubles in seconds, not necessarily 8 byte aligned.
+struct TransitionList {
+  const U8* times{};
+  U64 count{};
+  bool initial_high{};
+};
+
+// Extracts clocks straight from binary export transition lists. For each LCLK
+// falling edge, the LAD/LFRAMEn levels are the parity of the number of their
+// transitions up to that time. Uses AVX2 when the CPU has it: LCLK times are
+// converted to samples in blocks and the four LAD cursors are advanced
+// together in one vector.
+class TransitionClockExtractor {
+ public:
+  // channels are LAD[0..3], LFRAMEn, LCLK
+  TransitionClockExtractor(const std::array<TransitionList, 6>& channels,
+                           double origin,
+                           double sample_rate,
+                           U64 end_sample,
+                           bool allow_simd = true);
+
+  // Appends up to max_clocks clocks, returns the number appended.
+  size_t Extract(LpcClocks* out, size_t max_clocks);
+  // Continue extracting from the given clock (LCLK falling edge) onwards.
+  void Seek(U64 clock);
+  // Like ChannelClockExtractor::SetMinPulseWidth(), only with the scalar
+  // kernel. Clocks are counted before deglitching, by num_clocks(), Seek()
+  // and ClockAt() too.
+  void SetMinPulseWidth(U64 samples);
+  U64 glitches() const { return glitches_; }
+  U64 num_clocks() const;
+  // the first clock falling at or after |sample|, num_clocks() if none does
+  U64 ClockAt(U64 sample) const;
+  bool done() const { return lclk_index_ >= lclk_.count; }
+  bool using_simd() const { return use_avx2_; }
+
+ private:
+  size_t ExtractScalar(LpcClocks* out, size_t max_clocks);
+  size_t ExtractAvx2(LpcClocks* out, size_t max_clocks);
+
+  std::array<TransitionList, 5> data_;
+  TransitionList lclk_;
+  double origin_;
+  double sample_rate_;
+  U64 end_sample_;
+  bool use_avx2_;
+  // first LCLK falling edge
+  U64 lclk_first_{};
+  // next LCLK transition, always a falling edge
+  U64 lclk_index_{};
+  // number of transitions consumed per LAD[0..3], LFRAMEn
+  std::array<U64, 5> cursor_{};
+  // seconds, 0 takes every edge
+  double min_pulse_{};
+  U64 glitches_{};
+};
@@ -0,0 +1,121 @@
+#include "LpcCycleIndex.h"
+#include <algorithm>
+
+void LpcCycleIndex::Reset(U64 key) {
+  key_ = key;
+  blocks_.clear();
+  size_ = 0;
+  covered_ = kNone;
+  frame_asserted_ = false;
+}
+
+void LpcCycleIndex::Add(U64 sample, U8 start_code) {
+  if (blocks_.empty() || blocks_.back().offsets.size() == kBlockSize ||
+      sample - blocks_.back().base > 0xffffffffull) {
+    blocks_.push_back({sample, size_, 0, {}, {}});
+    blocks_.back().offsets.reserve(kBlockSize);
+    blocks_.back().codes.reserve(kBlockSize);
+  }
+  Block& block = blocks_.back();
+  block.offsets.push_back((U32)(sample - block.base));
+  block.codes.push_back(start_code);
+  block.start_codes |= 1 << start_code;
+  size_++;
+}
+
+void LpcCycleIndex::AddClocks(const LpcClocks& clocks) {
+  size_t i = 0;
+  if (covered_ != kNone) {
+    i = std::upper_bound(clocks.fall.begin(), clocks.fall.end(), covered_) -
+        clocks.fall.begin();
+  }
+  for (; i < clocks.size(); i++) {
+    const U8 bits = clocks.bits[i];
+    const bool asserted = !(bits & kLFRAMEnBit);
+    if (asserted) {
+      const U8 start_code = bits & kLADMask;
+      if (!frame_asserted_) {
+        Add(clocks.fall[i], start_code);
+      } else if (size_ > 0) {
+        // START is on the last clock LFRAMEn is asserted. The block's mask
+        // keeps the earlier value too, which only costs a look.
+        Block& block = blocks_.back();
+        block.codes.back() = start_code;
+        block.start_codes |= 1 << start_code;
+      }
+    }
+    frame_asserted_ = asserted;
+    covered_ = clocks.fall[i];
+  }
+}
+
+LpcCycleIndex::Check LpcCycleIndex::Verify(const LpcClocks& clocks) const {
+  if (covered_ == kNone || clocks.size() < 2 || clocks.fall[1] > covered_) {
+    return kUnknown;
+  }
+  size_t starts = 0;
+  size_t i = 1;
+  for (; i < clocks.size() && clocks.fall[i] <= covered_; i++) {
+    if (!(clocks.bits[i] & kLFRAMEnBit) && (clocks.bits[i - 1] & kLFRAMEnBit)) {
+      if (NextStart(clocks.fall[i], 0xffff) != clocks.fall[i]) {
+        return kMismatch;
+      }
+      starts++;
+    }
+  }
+  // and nothing in between that isn't there
+  if (Rank(clocks.fall[i - 1] + 1) - Rank(clocks.fall[1]) != starts) {
+    return kMismatch;
+  }
+  return starts > 0 ? kMatch : kUnknown;
+}
+
+size_t LpcCycleIndex::Rank(U64 sample) const {
+  auto block = std::upper_bound(
+      blocks_.begin(), blocks_.end(), sample,
+      [](U64 s, const Block& b) { return s < b.base; });
+  if (block == blocks_.begin()) {
+    return 0;
+  }
+  --block;
+  const U64 offset = std::min<U64>(sample - block->base, 0x100000000ull);
+  return block->first +
+         (std::lower_bound(block->offsets.begin(), block->offsets.end(),
+                           offset) -
+          block->offsets.begin());
+}
+
+U64 LpcCycleIndex::NextStart(U64 from, U16 start_codes) const {
+  // first block that may have entries at or after |from|
+  auto block = std::upper_bound(
+      blocks_.begin(), blocks_.end(), from,
+      [](U64 sample, const Block& b) { return sample < b.base; });
+  if (block != blocks_.begin()) {
+    --block;
+  }
+  for (; block != blocks_.end(); ++block) {
+    if (!(block->start_codes & start_codes)) {
+      continue;
+    }
+    U32 offset = 0;
+    if (from > block->base) {
+      offset = (U32)std::min<U64>(from - block->base, 0xffffffff);
+    }
+    size_t i = std::lower_bound(block->offsets.begin(), block->offsets.end(),
+                                offset) -
+               block->offsets.begin();
+    for (; i < block->offsets.size(); i++) {
+      if (start_codes >> block->codes[i] & 1) {
+        return block->base + block->offsets[i];
+      }
+    }
+  }
+  return kNone;
+}
+
+U64 LpcCycleIndex::LastStart() const {
+  if (blocks_.empty()) {
+    return kNone;
+  }
+  return blocks_.back().base + blocks_.back().offsets.back();
+}
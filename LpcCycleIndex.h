@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include "LpcClocks.h"
+#include "LpcDecoder.h"
+
+// Where every cycle starts (the first clock of LFRAMEn asserted) and its
+// START value, recorded on the first run over a capture. Reruns with a START
+// filter use it to skip straight over the cycles they would drop anyway,
+// instead of pulling every clock out of the channel data again.
+//
+// Entries are kept in blocks of up to kBlockSize, as 32 bit offsets from the
+// block's first sample plus a START byte, so about 5 bytes per cycle. Each
+// block has a mask of the START values in it, so a search for rare cycles
+// mostly skips whole blocks.
+class LpcCycleIndex {
+ public:
+  static constexpr size_t kBlockSize = 1024;
+  static constexpr U64 kNone = ~0ull;
+
+  // What the index was built from, the capture's channels and sample rate.
+  // Anything else and it is rebuilt.
+  U64 key() const { return key_; }
+  void Reset(U64 key);
+
+  enum Check { kUnknown, kMatch, kMismatch };
+  // Whether the cycle starts in |clocks| (as far as the index covers them)
+  // are exactly the ones in the index. Captures aren't told apart any other
+  // way, so a rerun checks this before trusting the index. kUnknown if there
+  // are none to compare.
+  Check Verify(const LpcClocks& clocks) const;
+
+  // Adds the cycle starts in |clocks|. Clocks must follow on from the last
+  // ones added; those at or before covered() are skipped, so after a seek
+  // back into the index, adding simply resumes where it left off.
+  void AddClocks(const LpcClocks& clocks);
+  // fall of the last clock added, kNone if none
+  U64 covered() const { return covered_; }
+  size_t size() const { return size_; }
+
+  // Sample of the first cycle start at or after |from| whose START is in
+  // |start_codes| (a bit per value), kNone if there is none up to covered().
+  U64 NextStart(U64 from, U16 start_codes) const;
+  // sample of the last cycle start, kNone if none
+  U64 LastStart() const;
+  // number of cycle starts before |sample|
+  size_t Rank(U64 sample) const;
+
+ private:
+  struct Block {
+    U64 base;
+    // entries in the blocks before
+    size_t first;
+    U16 start_codes;
+    std::vector<U32> offsets;
+    std::vector<U8> codes;
+  };
+  void Add(U64 sample, U8 start_code);
+
+  U64 key_{kNone};
+  std::vector<Block> blocks_;
+  size_t size_{};
+  U64 covered_{kNone};
+  // LFRAMEn of the clock at covered_
+  bool frame_asserted_{};
+};
@@ -0,0 +1,512 @@
+// Headless decoder for Logic 2 binary digital exports.
+//
+// usage: lpc_decode [options] <export dir>...
+//   --rate HZ          sample rate of the capture (required)
+//   --lad A,B,C,D      channel numbers of LAD[3:0] (default 0,1,2,3)
+//   --lframe N         channel number of LFRAMEn (default 4)
+//   --lclk N           channel number of LCLK (default 5)
+//   -o FILE            write decoded frames to FILE
+//   --no-simd          use the scalar clock extraction kernel
+//   --threads N        decode with N threads (default: all cores)
+//   --rom FILE         write the flash/ROM image rebuilt from the decoded
+//                      memory and FW cycles to FILE
+//   --latency FILE     write SYNC wait and duration percentiles per cycle
+//                      type and address bucket to FILE, as CSV
+//   --latency-buckets IO,MEM
+//                      address bits dropped to bucket IO and memory
+//                      addresses (default 0,12)
+//   --heatmap FILE     write the most accessed addresses and per region
+//                      access counts to FILE, as CSV
+//   --heatmap-block BITS
+//                      count the heatmap per 2^BITS addresses (default 0)
+//   --heatmap-top N    hot addresses listed in the heatmap (default 100)
+//   --min-pulse NS     ignore LCLK and LFRAMEn pulses shorter than NS, for
+//                      noisy probes (scalar kernel)
+//   --diff FILE        compare the cycles of exactly two export dirs (known
+//                      good first), write every changed, removed and
+//                      inserted cycle to FILE as CSV
+//
+// Each export dir is expected to contain the digital_N.bin files written by
+// Logic 2's binary export. Files are mapped and decoded in place.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include "LpcBinaryExport.h"
+#include "LpcDiff.h"
+#include "LpcExport.h"
+#include "LpcHeatmap.h"
+#include "LpcLatency.h"
+#include "LpcShadowMemory.h"
+#include "LpcThreadPool.h"
+
+struct Options {
+  double sample_rate{};
+  std::array<int, 6> channels{0, 1, 2, 3, 4, 5};
+  const char* frames_path{};
+  const char* rom_path{};
+  const char* latency_path{};
+  std::array<int, 2> latency_bits{0, 12};
+  const char* heatmap_path{};
+  int heatmap_bits{0};
+  size_t heatmap_top{100};
+  double min_pulse_ns{};
+  const char* diff_path{};
+  bool allow_simd{true};
+  size_t threads{std::thread::hardware_concurrency()};
+  std::vector<const char*> dirs;
+};
+
+static constexpr size_t kClocksPerBlock = 1 << 16;
+// With more than one thread the capture is cut into segments of about this
+// many clocks, each extracted and decoded on its own.
+static constexpr size_t kClocksPerSegment = 1 << 18;
+// clocks extracted ahead of a segment, for the glitch filter to settle
+static constexpr U64 kSegmentContextClocks = 16;
+
+static void Usage() {
+  std::fprintf(stderr,
+               "usage: lpc_decode --rate HZ [--lad A,B,C,D] [--lframe N] "
+               "[--lclk N] [-o FILE] [--no-simd] [--threads N] "
+               "[--rom FILE] [--latency FILE] [--latency-buckets IO,MEM] "
+               "[--heatmap FILE] [--heatmap-block BITS] [--heatmap-top N] "
+               "[--min-pulse NS] [--diff FILE] <export dir>...\n");
+  std::exit(2);
+}
+
+static bool ParseArgs(int argc, char** argv, Options* opts) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    bool has_value = i + 1 < argc;
+    if (arg == "--rate" && has_value) {
+      opts->sample_rate = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--lad" && has_value) {
+      auto& c = opts->channels;
+      if (std::sscanf(argv[++i], "%d,%d,%d,%d", &c[0], &c[1], &c[2], &c[3]) !=
+          4) {
+        return false;
+      }
+    } else if (arg == "--lframe" && has_value) {
+      opts->channels[4] = std::atoi(argv[++i]);
+    } else if (arg == "--lclk" && has_value) {
+      opts->channels[5] = std::atoi(argv[++i]);
+    } else if (arg == "-o" && has_value) {
+      opts->frames_path = argv[++i];
+    } else if (arg == "--no-simd") {
+      opts->allow_simd = false;
+    } else if (arg == "--threads" && has_value) {
+      opts->threads = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--rom" && has_value) {
+      opts->rom_path = argv[++i];
+    } else if (arg == "--latency" && has_value) {
+      opts->latency_path = argv[++i];
+    } else if (arg == "--latency-buckets" && has_value) {
+      auto& b = opts->latency_bits;
+      if (std::sscanf(argv[++i], "%d,%d", &b[0], &b[1]) != 2 || b[0] < 0 ||
+          b[0] > 16 || b[1] < 0 || b[1] > 32) {
+        return false;
+      }
+    } else if (arg == "--heatmap" && has_value) {
+      opts->heatmap_path = argv[++i];
+    } else if (arg == "--heatmap-block" && has_value) {
+      opts->heatmap_bits = std::atoi(argv[++i]);
+      if (opts->heatmap_bits < 0 || opts->heatmap_bits > 32) {
+        return false;
+      }
+    } else if (arg == "--heatmap-top" && has_value) {
+      opts->heatmap_top = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--min-pulse" && has_value) {
+      opts->min_pulse_ns = std::strtod(argv[++i], nullptr);
+    } else if (arg == "--diff" && has_value) {
+      opts->diff_path = argv[++i];
+    } else if (arg.starts_with("-")) {
+      return false;
+    } else {
+      opts->dirs.push_back(argv[i]);
+    }
+  }
+  if (opts->diff_path != nullptr && opts->dirs.size() != 2) {
+    return false;
+  }
+  return opts->sample_rate > 0 && !opts->dirs.empty();
+}
+
+// Where decoded cycles go, any may be null.
+struct Outputs {
+  FILE* frames{};
+  LpcShadowMemory* shadow{};
+  LpcLatencyStats* latency{};
+  LpcHeatmap* heatmap{};
+  // the capture's cycles, for --diff
+  LpcTransactionTable* transactions{};
+};
+
+struct DecodeTotals {
+  U64 clocks{};
+  U64 cycles{};
+  U64 frames{};
+};
+
+// Completed cycles only. The frames of the cycle in progress stay in the
+// decoder until it ends.
+static void WriteFrames(LpcDecoder& decoder,
+                        DecodeTotals* totals,
+                        const Outputs& out) {
+  size_t num_frames = 0;
+  for (auto& cycle : decoder.cycles_) {
+    num_frames += cycle.num_frames;
+  }
+  const U64 first_frame = totals->frames;
+  totals->cycles += decoder.cycles_.size();
+  totals->frames += num_frames;
+  if (out.frames != nullptr) {
+    for (size_t i = 0; i < num_frames; i++) {
+      const LpcFrame& f = decoder.frames_[i];
+      const char* name = FieldName(f.type);
+      std::fprintf(out.frames, "%llu %llu %s %llx\n", f.start, f.end,
+                   name != nullptr ? name : "?", f.data1);
+    }
+  }
+  if (out.shadow != nullptr) {
+    const LpcFrame* frames = decoder.frames_.data();
+    for (auto& cycle : decoder.cycles_) {
+      out.shadow->Replay(cycle, frames);
+      frames += cycle.num_frames;
+    }
+  }
+  if (out.latency != nullptr || out.heatmap != nullptr) {
+    const LpcFrame* frames = decoder.frames_.data();
+    for (auto& cycle : decoder.cycles_) {
+      const LpcTransaction t = SummarizeCycle(cycle, frames, 0);
+      if (out.latency != nullptr) {
+        out.latency->Add(t);
+      }
+      if (out.heatmap != nullptr) {
+        out.heatmap->Add(t);
+      }
+      frames += cycle.num_frames;
+    }
+  }
+  if (out.transactions != nullptr) {
+    const LpcFrame* frames = decoder.frames_.data();
+    U64 frame = first_frame;
+    for (auto& cycle : decoder.cycles_) {
+      out.transactions->Append(cycle, frames, frame);
+      frames += cycle.num_frames;
+      frame += cycle.num_frames;
+    }
+  }
+  decoder.cycles_.clear();
+  decoder.frames_.erase(decoder.frames_.begin(),
+                        decoder.frames_.begin() + num_frames);
+}
+
+static void DecodeSequential(TransitionClockExtractor& extractor,
+                             DecodeTotals* totals,
+                             const Outputs& out) {
+  LpcDecoder decoder;
+  LpcClocks clocks;
+  while (true) {
+    totals->clocks += extractor.Extract(&clocks, kClocksPerBlock);
+    const bool final = extractor.done();
+    decoder.Decode(clocks);
+    clocks.clear();
+    if (final) {
+      decoder.Finish();
+    }
+    WriteFrames(decoder, totals, out);
+    if (final) {
+      break;
+    }
+  }
+}
+
+// A segment owns the cycles starting on clocks that fall in its samples
+// [from, to), and decodes past its end until the next cycle start to finish
+// the last one. Cycles starting before the first cycle start in a segment
+// belong to the one before. Segments are cut by time, not by clock count, so
+// that glitches taken out of LCLK don't move the cuts.
+struct Segment {
+  LpcDecoder decoder;
+  U64 clocks{};
+};
+
+static void DecodeSegment(const std::array<TransitionList, 6>& lists,
+                          double origin,
+                          double sample_rate,
+                          U64 end_sample,
+                          bool allow_simd,
+                          U64 min_pulse,
+                          U64 from,
+                          U64 to,
+                          Segment* segment) {
+  TransitionClockExtractor extractor(lists, origin, sample_rate, end_sample,
+                                     allow_simd);
+  extractor.SetMinPulseWidth(min_pulse);
+  const U64 first = extractor.ClockAt(from);
+  extractor.Seek(first > kSegmentContextClocks ? first - kSegmentContextClocks
+                                               : 0);
+  LpcClocks clocks;
+  while (!extractor.done() && (clocks.size() == 0 || clocks.fall.back() < to)) {
+    extractor.Extract(&clocks, kClocksPerBlock);
+  }
+  const auto fall_at = [&clocks](U64 sample) {
+    return (size_t)(std::lower_bound(clocks.fall.begin(), clocks.fall.end(),
+                                     sample) -
+                    clocks.fall.begin());
+  };
+  const size_t window_begin = fall_at(from);
+  const size_t window_end = fall_at(to);
+  segment->clocks = window_end - window_begin;
+
+  // from the very first clock, as the sequential decode does
+  const size_t begin =
+      window_begin > 0 ? clocks.NextCycleStart(window_begin) : 0;
+  size_t end = clocks.NextCycleStart(window_end);
+  while (end == clocks.size() && !extractor.done()) {
+    const size_t more = clocks.size();
+    extractor.Extract(&clocks, kClocksPerBlock);
+    end = clocks.NextCycleStart(more);
+  }
+  if (begin >= window_end) {
+    return;
+  }
+  segment->decoder.Decode(clocks, begin, end);
+  segment->decoder.Finish();
+}
+
+static void DecodeParallel(const std::array<TransitionList, 6>& lists,
+                           const Options& opts,
+                           double origin,
+                           U64 end_sample,
+                           U64 num_clocks,
+                           U64 min_pulse,
+                           DecodeTotals* totals,
+                           const Outputs& out) {
+  LpcThreadPool pool(opts.threads);
+  const U64 num_segments =
+      (num_clocks + kClocksPerSegment - 1) / kClocksPerSegment;
+  // samples per segment, the last one takes the rest
+  const U64 window = end_sample / std::max<U64>(num_segments, 1) + 1;
+  // a few segments per thread at a time keeps memory bounded and leaves
+  // something to steal
+  const U64 wave = pool.size() * 4;
+  std::vector<Segment> segments;
+  for (U64 first = 0; first < num_segments; first += wave) {
+    const U64 n = std::min(wave, num_segments - first);
+    segments.assign(n, {});
+    pool.ParallelFor(n, [&](size_t i) {
+      const U64 k = first + i;
+      const U64 to = k + 1 < num_segments ? (k + 1) * window : ~0ull;
+      DecodeSegment(lists, origin, opts.sample_rate, end_sample,
+                    opts.allow_simd, min_pulse, k * window, to, &segments[i]);
+    });
+    for (auto& segment : segments) {
+      totals->clocks += segment.clocks;
+      WriteFrames(segment.decoder, totals, out);
+    }
+  }
+}
+
+static bool DecodeCapture(const Options& opts,
+                          const char* dir,
+                          const Outputs& out) {
+  // LAD[0..3], LFRAMEn, LCLK
+  std::array<BinaryExportChannel, 6> files;
+  size_t total_bytes = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    auto path = std::string(dir) + "/digital_" +
+                std::to_string(opts.channels[i]) + ".bin";
+    std::string error;
+    if (!files[i].Open(path.c_str(), &error)) {
+      std::fprintf(stderr, "%s\n", error.c_str());
+      return false;
+    }
+    total_bytes += files[i].size_bytes();
+  }
+  // Every channel of a capture shares the same timebase
+  const double origin = files[5].begin_time();
+  const U64 end_sample =
+      (U64)((files[5].end_time() - origin) * opts.sample_rate + .5);
+  std::array<TransitionList, 6> lists;
+  for (size_t i = 0; i < files.size(); i++) {
+    lists[i] = files[i].transitions();
+  }
+  TransitionClockExtractor extractor(lists, origin, opts.sample_rate,
+                                     end_sample, opts.allow_simd);
+  const U64 min_pulse = (U64)(opts.min_pulse_ns * 1e-9 * opts.sample_rate);
+  extractor.SetMinPulseWidth(min_pulse);
+
+  DecodeTotals totals;
+  auto t0 = std::chrono::steady_clock::now();
+  const size_t threads = std::max<size_t>(opts.threads, 1);
+  if (threads > 1) {
+    DecodeParallel(lists, opts, origin, end_sample, extractor.num_clocks(),
+                   min_pulse, &totals, out);
+  } else {
+    DecodeSequential(extractor, &totals, out);
+  }
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() - t0;
+
+  std::printf(
+      "%s: %llu clocks, %llu cycles, %llu frames, %.1f MB in %.3f s "
+      "(%.3f GB/s, %s, %zu threads)\n",
+      dir, totals.clocks, totals.cycles, totals.frames, total_bytes / 1e6,
+      secs.count(), total_bytes / 1e9 / secs.count(),
+      extractor.using_simd() ? "avx2" : "scalar",
+      threads);
+  if (opts.min_pulse_ns > 0) {
+    std::printf("%s: %llu glitches ignored\n", dir, extractor.glitches());
+  }
+  return true;
+}
+
+static bool WriteRomImage(const LpcShadowMemory& shadow, const char* path) {
+  FILE* rom = std::fopen(path, "wb");
+  if (rom == nullptr) {
+    std::perror(path);
+    return false;
+  }
+  U64 begin = 0;
+  U64 size = 0;
+  shadow.RomImageRange(&begin, &size);
+  std::vector<U8> chunk(LpcShadowSpace::kPageSize * 16);
+  for (U64 done = 0; done < size; done += chunk.size()) {
+    shadow.memory.CopyOut(begin + done, chunk.size(), 0xff, chunk.data());
+    std::fwrite(chunk.data(), 1, chunk.size(), rom);
+  }
+  const bool ok = std::ferror(rom) == 0;
+  std::fclose(rom);
+  std::printf(
+      "%s: %llx-%llx, %llu cycles replayed, %llu bytes seen in %zu pages "
+      "(memory), %llu (IO)\n",
+      path, begin, begin + size - 1, shadow.replayed_cycles,
+      shadow.memory.num_observed(), shadow.memory.num_pages(),
+      shadow.io.num_observed());
+  return ok;
+}
+
+// Prints where |b| first diverges from |a| and how much differs.
+static bool WriteDiff(const LpcTransactionTable& a,
+                      const LpcTransactionTable& b,
+                      const char* path) {
+  auto t0 = std::chrono::steady_clock::now();
+  const std::vector<LpcDiffOp> ops = DiffTransactions(a, b);
+  std::chrono::duration<double> secs = std::chrono::steady_clock::now() - t0;
+
+  std::array<U64, 4> counts{};
+  const LpcDiffOp* first = nullptr;
+  for (const auto& op : ops) {
+    counts[op.kind] += op.count;
+    if (first == nullptr && op.kind != LpcDiffOp::kSame) {
+      first = &op;
+    }
+  }
+  std::printf(
+      "%s: %llu cycles the same, %llu changed, %llu removed, %llu inserted "
+      "(%.3f s)\n",
+      path, counts[LpcDiffOp::kSame], counts[LpcDiffOp::kChanged],
+      counts[LpcDiffOp::kRemoved], counts[LpcDiffOp::kInserted], secs.count());
+  if (first != nullptr) {
+    // past the end of a capture if everything before matched
+    auto sample = [](const LpcTransactionTable& t, U64 i) {
+      return i < t.size() ? t.start[i] : t.size() > 0 ? t.end.back() : 0;
+    };
+    std::printf("%s: first divergence at cycle %llu (sample %llu) / %llu "
+                "(sample %llu)\n",
+                path, first->a, sample(a, first->a), first->b,
+                sample(b, first->b));
+  }
+
+  LpcTextWriter out;
+  if (out.Open(path)) {
+    ExportDiffCsv(out, a, b, ops);
+  }
+  if (!out.Close()) {
+    std::perror(path);
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  Options opts;
+  if (!ParseArgs(argc, argv, &opts)) {
+    Usage();
+  }
+
+  FILE* frames = nullptr;
+  if (opts.frames_path != nullptr) {
+    frames = std::fopen(opts.frames_path, "w");
+    if (frames == nullptr) {
+      std::perror(opts.frames_path);
+      return 1;
+    }
+    static char buf[1 << 20];
+    std::setvbuf(frames, buf, _IOFBF, sizeof(buf));
+  }
+
+  // captures are replayed in order, later ones overwrite earlier values
+  std::unique_ptr<LpcShadowMemory> shadow;
+  if (opts.rom_path != nullptr) {
+    shadow = std::make_unique<LpcShadowMemory>();
+  }
+  std::unique_ptr<LpcLatencyStats> latency;
+  if (opts.latency_path != nullptr) {
+    latency = std::make_unique<LpcLatencyStats>();
+    latency->io_bucket_bits = (U8)opts.latency_bits[0];
+    latency->memory_bucket_bits = (U8)opts.latency_bits[1];
+  }
+  std::unique_ptr<LpcHeatmap> heatmap;
+  if (opts.heatmap_path != nullptr) {
+    heatmap = std::make_unique<LpcHeatmap>();
+    heatmap->block_bits = (U8)opts.heatmap_bits;
+  }
+
+  // one per dir with --diff
+  std::vector<LpcTransactionTable> transactions(
+      opts.diff_path != nullptr ? opts.dirs.size() : 0);
+
+  int rv = 0;
+  for (size_t i = 0; i < opts.dirs.size(); i++) {
+    if (!DecodeCapture(opts, opts.dirs[i],
+                       {frames, shadow.get(), latency.get(), heatmap.get(),
+                        transactions.empty() ? nullptr : &transactions[i]})) {
+      rv = 1;
+    }
+  }
+  if (frames != nullptr) {
+    std::fclose(frames);
+  }
+  if (shadow != nullptr && !WriteRomImage(*shadow, opts.rom_path)) {
+    rv = 1;
+  }
+  if (latency != nullptr) {
+    LpcTextWriter out;
+    if (out.Open(opts.latency_path)) {
+      ExportLatencyCsv(out, *latency, opts.sample_rate);
+    }
+    if (!out.Close()) {
+      std::perror(opts.latency_path);
+      rv = 1;
+    }
+  }
+  if (heatmap != nullptr) {
+    LpcTextWriter out;
+    if (out.Open(opts.heatmap_path)) {
+      ExportHeatmapCsv(out, *heatmap, opts.heatmap_top);
+    }
+    if (!out.Close()) {
+      std::perror(opts.heatmap_path);
+      rv = 1;
+    }
+  }
+  if (!transactions.empty() && rv == 0 &&
+      !WriteDiff(transactions[0], transactions[1], opts.diff_path)) {
+    rv = 1;
+  }
+  return rv;
+}
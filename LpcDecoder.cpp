@@ -0,0 +1,466 @@
+#include "LpcDecoder.h"
+#include <cstdlib>
+#include "LpcClocks.h"
+
+// Cycles are decoded by a flat state machine with one state per nibble. The
+// state table is generated at compile time from the field layout of each
+// cycle, so adding a cycle type only needs a new layout and an entry point.
+//
+// START is handled outside the table: whenever LFRAMEn is asserted the
+// machine goes to kStartState (aborting whatever cycle was in progress), and
+// the first clock after LFRAMEn deasserts is dispatched on the START value.
+
+struct FieldLayout {
+  FieldType field;
+  // kSYNC repeats until a terminal sync code, regardless of nibbles
+  U8 nibbles;
+  NibbleEndian endian;
+};
+
+// DATA bytes, as many as the preceding MSIZE says
+static constexpr U8 kRunNibbles = 0;
+
+static constexpr FieldLayout kIoReadLayout[] = {
+    {kADDR, 4, kMSNFirst},
+    {kTURN_AROUND, 2, kLSNFirst},
+    {kSYNC, 1, kLSNFirst},
+    {kDATA, 2, kLSNFirst},
+    {kTURN_AROUND, 2, kLSNFirst},
+};
+static constexpr FieldLayout kIoWriteLayout[] = {
+    {kADDR, 4, kMSNFirst},
+    {kDATA, 2, kLSNFirst},
+    {kTURN_AROUND, 2, kLSNFirst},
+    {kSYNC, 1, kLSNFirst},
+    {kTURN_AROUND, 2, kLSNFirst},
+};
+static constexpr FieldLayout kMemReadLayout[] = {
+    {kADDR, 8, kMSNFirst},
+    {kTURN_AROUND, 2, kLSNFirst},
+    {kSYNC, 1, kLSNFirst},
+    {kDATA, 2, kLSNFirst},
+    {kTURN_AROUND, 2, kLSNFirst},
+};
+static constexpr FieldLayout kMemWriteLayout[] = {
+    {kADDR, 8, kMSNFirst},
+    {kDATA, 2, kLSNFirst},
+    {kTURN_AROUND, 2, kLSNFirst},
+    {kSYNC, 1, kLSNFirst},
+    {kTURN_AROUND, 2, kLSNFirst},
+};
+// FW cycles have no CYCTYPE, START says which one it is
+static constexpr FieldLayout kFwReadLayout[] = {
+    {kIDSEL, 1, kLSNFirst},
+    {kADDR, 7, kMSNFirst},
+    {kMSIZE, 1, kLSNFirst},
+    {kTURN_AROUND, 2, kLSNFirst},
+    {kSYNC, 1, kLSNFirst},
+    {kDATA, kRunNibbles, kLSNFirst},
+    {kTURN_AROUND, 2, kLSNFirst},
+};
+static constexpr FieldLayout kFwWriteLayout[] = {
+    {kIDSEL, 1, kLSNFirst},
+    {kADDR, 7, kMSNFirst},
+    {kMSIZE, 1, kLSNFirst},
+    {kDATA, kRunNibbles, kLSNFirst},
+    {kTURN_AROUND, 2, kLSNFirst},
+    {kSYNC, 1, kLSNFirst},
+    {kTURN_AROUND, 2, kLSNFirst},
+};
+
+// DMA cycles: CHANNEL and SIZE, then the per byte part once for each byte.
+static constexpr FieldLayout kDmaReadLayout[] = {
+    {kCHANNEL, 1, kLSNFirst},
+    {kSIZE, 1, kLSNFirst},
+};
+// host to peripheral, each byte is handed over and SYNCed on its own
+static constexpr FieldLayout kDmaReadByteLayout[] = {
+    {kDATA, 2, kLSNFirst},
+    {kTURN_AROUND, 2, kLSNFirst},
+    {kSYNC, 1, kLSNFirst},
+    {kTURN_AROUND, 2, kLSNFirst},
+};
+static constexpr FieldLayout kDmaWriteLayout[] = {
+    {kCHANNEL, 1, kLSNFirst},
+    {kSIZE, 1, kLSNFirst},
+    {kTURN_AROUND, 2, kLSNFirst},
+};
+// peripheral to host, a SYNC (Ready or ReadyMore) before each byte
+static constexpr FieldLayout kDmaWriteByteLayout[] = {
+    {kSYNC, 1, kLSNFirst},
+    {kDATA, 2, kLSNFirst},
+};
+static constexpr FieldLayout kDmaWriteEndLayout[] = {
+    {kTURN_AROUND, 2, kLSNFirst},
+};
+
+enum StateFlags : U8 {
+  // first nibble of the field
+  kFirst = 1 << 0,
+  // last nibble of the field, emit a frame
+  kEmit = 1 << 1,
+  // nibbles are least significant first
+  kLsn = 1 << 2,
+  // stay in this state until a terminal sync code
+  kRepeatSync = 1 << 3,
+  // next state depends on the CYCTYPE_DIR value
+  kDispatchCyctype = 1 << 4,
+  // value is MSIZE or SIZE, sets the number of bytes that follow
+  kSetRun = 1 << 5,
+  // DATA bytes until the run is done, a frame per byte
+  kDataRun = 1 << 6,
+  // end of a per byte part, back to |loop| while there are bytes left
+  kNextByte = 1 << 7,
+};
+
+struct LpcState {
+  FieldType field;
+  U8 flags;
+  U8 shift;
+  U8 next;
+  // kNextByte only
+  U8 loop{};
+};
+
+static constexpr U8 kIdleState = 0;
+static constexpr U8 kStartState = 1;
+static constexpr U8 kCyctypeState = 2;
+
+struct LpcStateTable {
+  std::array<LpcState, 128> states{};
+  U8 num_states{};
+  // by START value, for the clock after LFRAMEn deasserts
+  std::array<U8, 16> start_entry{};
+  // by CYCTYPE_DIR value
+  std::array<U8, 8> cyctype_entry{};
+
+  // The last state goes back to idle, or with |chain| on to whatever is added
+  // next.
+  template <size_t N>
+  constexpr U8 AddLayout(const FieldLayout (&layout)[N], bool chain = false) {
+    const U8 first = num_states;
+    for (auto& f : layout) {
+      if (f.nibbles == kRunNibbles) {
+        states[num_states] = {f.field, kDataRun, 0, (U8)(num_states + 1)};
+        num_states++;
+        continue;
+      }
+      for (U8 i = 0; i < f.nibbles; i++) {
+        LpcState s{f.field, 0, 0, (U8)(num_states + 1)};
+        if (i == 0) {
+          s.flags |= kFirst;
+        }
+        if (i + 1 == f.nibbles) {
+          s.flags |= kEmit;
+        }
+        if (f.endian == kLSNFirst) {
+          s.flags |= kLsn;
+          s.shift = i * 4;
+        }
+        if (f.field == kSYNC) {
+          s.flags |= kRepeatSync;
+        }
+        if (f.field == kMSIZE || f.field == kSIZE) {
+          s.flags |= kSetRun;
+        }
+        states[num_states++] = s;
+      }
+    }
+    if (!chain) {
+      states[num_states - 1].next = kIdleState;
+    }
+    return first;
+  }
+
+  // |layout| once per byte of a preceding SIZE
+  template <size_t N>
+  constexpr U8 AddPerByteLayout(const FieldLayout (&layout)[N],
+                                bool chain = false) {
+    const U8 first = AddLayout(layout, chain);
+    states[num_states - 1].flags |= kNextByte;
+    states[num_states - 1].loop = first;
+    return first;
+  }
+};
+
+static constexpr LpcStateTable BuildStateTable() {
+  LpcStateTable t;
+  t.states[kIdleState] = {kSTART, 0, 0, kIdleState};
+  t.states[kStartState] = {kSTART, 0, 0, kIdleState};
+  // TODO is it interesting to keep/show ignored bit?
+  t.states[kCyctypeState] = {kCYCTYPE_DIR, kFirst | kEmit | kDispatchCyctype,
+                             0, kIdleState};
+  t.num_states = kCyctypeState + 1;
+
+  // Stop cycles have one clock of inactive LFRAMEn, but we're already there.
+  // TODO indicate unknown cycle
+  t.start_entry.fill(kIdleState);
+  t.start_entry[kStart] = kCyctypeState;
+  t.start_entry[kTpmStart] = kCyctypeState;
+  t.start_entry[kFwRead] = t.AddLayout(kFwReadLayout);
+  t.start_entry[kFwWrite] = t.AddLayout(kFwWriteLayout);
+
+  t.cyctype_entry.fill(kIdleState);
+  t.cyctype_entry[kIoRead] = t.AddLayout(kIoReadLayout);
+  t.cyctype_entry[kIoWrite] = t.AddLayout(kIoWriteLayout);
+  t.cyctype_entry[kMemRead] = t.AddLayout(kMemReadLayout);
+  t.cyctype_entry[kMemWrite] = t.AddLayout(kMemWriteLayout);
+  t.cyctype_entry[kDmaRead] = t.AddLayout(kDmaReadLayout, true);
+  t.AddPerByteLayout(kDmaReadByteLayout);
+  t.cyctype_entry[kDmaWrite] = t.AddLayout(kDmaWriteLayout, true);
+  t.AddPerByteLayout(kDmaWriteByteLayout, true);
+  t.AddLayout(kDmaWriteEndLayout);
+  return t;
+}
+
+static constexpr LpcStateTable kStateTable = BuildStateTable();
+
+// Bytes in a FW data run by MSIZE, and in a DMA transfer by SIZE (LAD[1:0]).
+// Reserved values are taken as 1 byte.
+static constexpr std::array<U8, 16> kMsizeBytes = {1, 2, 4, 1, 16, 1, 1, 128,
+                                                   1, 1, 1, 1, 1,  1, 1, 1};
+static constexpr std::array<U8, 4> kDmaSizeBytes = {1, 2, 1, 4};
+
+// Each clock is a sync value, driven by whichever side is busy (slave).
+// Eventually (the spec has timeouts, but we probably shouldn't rely on
+// them?) a final value is driven (Ready, ReadyMore, Error) and the slave
+// stops driving. The master drives the bus afterwards for 1 clock.
+// Technically ReadyMore is only valid for DMA.
+static constexpr std::array<bool, 16> kSyncDone = [] {
+  std::array<bool, 16> done{};
+  done[kReady] = done[kReadyMore] = done[kError] = true;
+  return done;
+}();
+
+void LpcDecoder::Decode(const LpcClocks& clocks) {
+  Decode(clocks, 0, clocks.size());
+}
+
+void LpcDecoder::Decode(const LpcClocks& clocks, size_t begin, size_t end) {
+  const auto& t = kStateTable;
+  if constexpr (LPC_STATS) {
+    counts_.clocks += end - begin;
+  }
+  for (size_t i = begin; i < end; i++) {
+    const U8 bits = clocks.bits[i];
+    const U8 lad = bits & kLADMask;
+    const U64 fall = clocks.fall[i];
+
+    // Next LFRAMEn may occur at any time. If before end of current cycle,
+    // it means the current cycle is being aborted.
+    if (!(bits & kLFRAMEnBit)) {
+      if (state_ > kStartState) {
+        EndCycle(last_fall_, kCycleAborted);
+      }
+      if (state_ != kStartState) {
+        cycle_num_frames_ = 0;
+        state_ = kStartState;
+      }
+      // START is LAD[3:0] of clock *before* LFRAMEn deasserts
+      start_code_ = lad;
+      start_sample_ = fall;
+      last_fall_ = fall;
+      continue;
+    }
+    last_fall_ = fall;
+    if (state_ == kIdleState) {
+      continue;
+    }
+    if (state_ == kStartState) {
+      // this is the first clock after LFRAMEn deasserted
+      AddFrame(kSTART, start_sample_, fall, start_code_);
+      state_ = t.start_entry[start_code_];
+      if (state_ == kIdleState) {
+        EndCycle(fall);
+        continue;
+      }
+    }
+
+    const LpcState& s = t.states[state_];
+    if (s.flags & kDataRun) {
+      if (!run_high_) {
+        // Bulk path: whole bytes straight from the clocks, for as long as
+        // they are in this block and LFRAMEn stays deasserted.
+        size_t j = i;
+        while (run_left_ > 0 && j + 1 < end &&
+               (clocks.bits[j] & clocks.bits[j + 1] & kLFRAMEnBit)) {
+          const U8 value = (clocks.bits[j] & kLADMask) |
+                           (clocks.bits[j + 1] & kLADMask) << 4;
+          AddFrame(kDATA, clocks.fall[j], clocks.rise[j + 1], value);
+          run_left_--;
+          j += 2;
+        }
+        if (j > i) {
+          i = j - 1;
+          last_fall_ = clocks.fall[i];
+          if (run_left_ == 0) {
+            state_ = s.next;
+          }
+          continue;
+        }
+        // the byte is split across blocks, go nibble by nibble
+        field_start_ = fall;
+        field_value_ = lad;
+        run_high_ = true;
+        continue;
+      }
+      field_value_ |= lad << 4;
+      AddFrame(kDATA, field_start_, clocks.rise[i], field_value_);
+      run_high_ = false;
+      if (--run_left_ == 0) {
+        state_ = s.next;
+      }
+      continue;
+    }
+    if (s.flags & kFirst) {
+      field_start_ = fall;
+      field_value_ = 0;
+    }
+    if (s.flags & kLsn) {
+      field_value_ |= (U64)lad << s.shift;
+    } else {
+      field_value_ = (field_value_ << 4) | lad;
+    }
+    U8 next = s.next;
+    if (s.flags & kDispatchCyctype) {
+      field_value_ = lad >> 1;
+      next = t.cyctype_entry[field_value_];
+    }
+    if (s.flags & kSetRun) {
+      run_left_ = s.field == kMSIZE ? kMsizeBytes[lad] : kDmaSizeBytes[lad & 3];
+      run_high_ = false;
+    }
+    if ((s.flags & kRepeatSync) && !kSyncDone[lad]) {
+      next = state_;
+    } else if ((s.flags & kNextByte) && --run_left_ > 0) {
+      next = s.loop;
+    }
+    if (s.flags & kEmit) {
+      AddFrame(s.field, field_start_, clocks.rise[i], field_value_);
+    }
+    state_ = next;
+    if (state_ == kIdleState) {
+      EndCycle(fall);
+    }
+  }
+}
+
+void LpcDecoder::Finish() {
+  if (state_ > kStartState) {
+    EndCycle(last_fall_, kCycleAborted);
+  }
+  state_ = kIdleState;
+}
+
+void LpcDecoder::EndCycle(U64 end, U8 flags) {
+  const LpcCycle cycle{start_sample_, end, cycle_num_frames_, start_code_,
+                       flags};
+  if constexpr (LPC_STATS) {
+    counts_.cycles++;
+    counts_.aborted_cycles += (flags & kCycleAborted) != 0;
+  }
+  // the cycle's frames are the last ones
+  const size_t first = frames_.size() - cycle_num_frames_;
+  if (filter_ == nullptr || filter_->Keep(cycle, frames_.data() + first)) {
+    cycles_.push_back(cycle);
+  } else {
+    frames_.resize(first);
+  }
+  cycle_num_frames_ = 0;
+  state_ = kIdleState;
+}
+
+bool LpcDecoder::AddFrame(FieldType field,
+                          U64 start,
+                          U64 end,
+                          U64 data1,
+                          U64 data2,
+                          U8 flags) {
+  if constexpr (LPC_STATS) {
+    counts_.frames++;
+    counts_.rejected_frames += start >= end;
+  }
+  // NOTE: end - start must be > 0 or Logic crashes when trying to zoom to the
+  // frame
+  if (start >= end) {
+    return false;
+  }
+  frames_.push_back({start, end, data1, data2, field, flags});
+  cycle_num_frames_++;
+  return true;
+}
+
+bool LpcCycleFilter::Keep(const LpcCycle& cycle,
+                          const LpcFrame* frames) const {
+  if (!(start_codes >> cycle.start_code & 1)) {
+    return false;
+  }
+  bool has_address = false;
+  U32 address = 0;
+  for (U32 i = 0; i < cycle.num_frames; i++) {
+    const LpcFrame& f = frames[i];
+    if (f.type == kCYCTYPE_DIR && !(cycle_types >> f.data1 & 1)) {
+      return false;
+    }
+    if (f.type == kADDR) {
+      has_address = true;
+      address = (U32)f.data1;
+    }
+  }
+  if (addresses.empty()) {
+    return true;
+  }
+  if (!has_address) {
+    return false;
+  }
+  for (auto& r : addresses) {
+    if (address >= r.first && address <= r.second) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ParseAddressRanges(const char* text,
+                        std::vector<std::pair<U32, U32>>* ranges) {
+  ranges->clear();
+  auto skip_spaces = [&] {
+    while (*text == ' ') {
+      text++;
+    }
+  };
+  auto hex = [&](U32* value) {
+    skip_spaces();
+    char* end;
+    const unsigned long long v = std::strtoull(text, &end, 16);
+    if (end == text || v > 0xffffffff) {
+      return false;
+    }
+    *value = (U32)v;
+    text = end;
+    skip_spaces();
+    return true;
+  };
+  skip_spaces();
+  while (*text != '\0') {
+    U32 first;
+    if (!hex(&first)) {
+      return false;
+    }
+    U32 last = first;
+    if (*text == '-' && (text++, !hex(&last))) {
+      return false;
+    }
+    if (last < first) {
+      return false;
+    }
+    ranges->emplace_back(first, last);
+    if (*text == ',') {
+      text++;
+      skip_spaces();
+    } else if (*text != '\0') {
+      return false;
+    }
+  }
+  return true;
+}
@@ -0,0 +1,196 @@
+#pragma once
+
+// Decoder core shared by the Logic plugin and the headless tools. It must not
+// depend on the SDK. It works on LpcClocks, which the callers extract from
+// whatever they have the capture in (see LpcClocks.h).
+
+#if __has_include(<LogicPublicTypes.h>)
+#include <LogicPublicTypes.h>
+#else
+// Same definitions as LogicPublicTypes.h, for builds without the SDK.
+typedef signed char S8;
+typedef signed short S16;
+typedef signed int S32;
+typedef signed long long int S64;
+typedef unsigned char U8;
+typedef unsigned short U16;
+typedef unsigned int U32;
+typedef unsigned long long int U64;
+enum DisplayBase { Binary, Decimal, Hexadecimal, ASCII, AsciiHex };
+enum BitState { BIT_LOW, BIT_HIGH };
+#endif
+
+#include <array>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Build with LPC_STATS=1 to count and time what the decoder does, see
+// LpcStats.h. Off, the counting compiles to nothing.
+#ifndef LPC_STATS
+#define LPC_STATS 0
+#endif
+
+// LAD[3:1], bit0 always ignored
+enum CycleType : U8 {
+  kIoRead,
+  kIoWrite,
+  kMemRead,
+  kMemWrite,
+  kDmaRead,
+  kDmaWrite,
+};
+
+enum StartCode : U8 {
+  kStart = 0b0000,
+  kBusMasterGrant0 = 0b0010,
+  kBusMasterGrant1 = 0b0011,
+  kTpmStart = 0b0101,
+  kFwRead = 0b1101,
+  kFwWrite = 0b1110,
+  kStop = 0b1111,
+};
+
+enum SyncCode : U8 {
+  kReady = 0b0000,
+  kShortWait = 0b0101,
+  kLongWait = 0b0110,
+  kReadyMore = 0b1001,
+  kError = 0b1010,
+};
+
+// The protocol encodes the expected format of successive fields in the START
+// and CYCTYPE fields. We explicitly type the frames.
+enum FieldType : U8 {
+  kSTART,
+  kCYCTYPE_DIR,
+  kSIZE,
+  kTURN_AROUND,
+  kADDR,
+  kCHANNEL,
+  kDATA,
+  kSYNC,
+  // FW cycles
+  kIDSEL,
+  kMSIZE,
+  // a TPM command or response, see LpcTpm.h
+  kTPM_MESSAGE,
+  // a whole cycle in one frame, see LpcTransactions.h
+  kCYCLE,
+};
+
+enum NibbleEndian {
+  kLSNFirst,
+  kMSNFirst,
+};
+
+// Same layout as the SDK's Frame, minus the SDK.
+struct LpcFrame {
+  U64 start;
+  U64 end;
+  U64 data1;
+  U64 data2;
+  FieldType type;
+  U8 flags;
+};
+
+template <typename ChannelData>
+struct LpcDecoderChannels {
+  std::array<ChannelData*, 4> LAD{};
+  ChannelData* LFRAMEn{};
+  ChannelData* LCLK{};
+};
+
+enum LpcCycleFlags : U8 {
+  // LFRAMEn was asserted (or the capture ended) before the cycle completed
+  kCycleAborted = 1 << 0,
+};
+
+struct LpcCycle {
+  // sample of the START field
+  U64 start;
+  // sample of the last clock of the cycle
+  U64 end;
+  U32 num_frames;
+  U8 start_code;
+  U8 flags;
+};
+
+// Which cycles to keep. The others are still decoded, to stay in sync, but
+// they and their frames are dropped when they end, so they never reach the
+// results.
+struct LpcCycleFilter {
+  // bit per START value
+  U16 start_codes{0xffff};
+  // bit per CYCTYPE_DIR value, for cycles that have one
+  U8 cycle_types{0xff};
+  // [first, last] as on the bus, in any address space. If there are any,
+  // cycles without an address (DMA, Stop, ...) are dropped too.
+  std::vector<std::pair<U32, U32>> addresses;
+
+  bool KeepsAll() const {
+    return start_codes == 0xffff && cycle_types == 0xff && addresses.empty();
+  }
+  // |frames| are the cycle's frames
+  bool Keep(const LpcCycle& cycle, const LpcFrame* frames) const;
+};
+
+// Parses address ranges like "80, fed40000-fed44fff" (hex). Returns false if
+// malformed.
+bool ParseAddressRanges(const char* text,
+                        std::vector<std::pair<U32, U32>>* ranges);
+
+// What one decoder did, only counted with LPC_STATS.
+struct LpcDecoderCounts {
+  U64 clocks;
+  U64 frames;
+  // AddFrame() calls dropped for start >= end
+  U64 rejected_frames;
+  // before filtering
+  U64 cycles;
+  U64 aborted_cycles;
+};
+
+struct LpcClocks;
+
+class LpcDecoder {
+ public:
+  // Decodes |clocks|, which continue from the previous call. Completed cycles
+  // are appended to cycles_ and their frames to frames_. Frames of a cycle
+  // still in progress are appended as well, ahead of the cycle itself.
+  void Decode(const LpcClocks& clocks);
+  // Same, for clocks [begin, end) only.
+  void Decode(const LpcClocks& clocks, size_t begin, size_t end);
+  // End of capture: closes the cycle in progress, if any.
+  void Finish();
+
+  bool AddFrame(FieldType field,
+                U64 start,
+                U64 end,
+                U64 data1 = 0,
+                U64 data2 = 0,
+                U8 flags = 0);
+  void EndCycle(U64 end, U8 flags = 0);
+  // between cycles, with nothing in progress (kIdleState)
+  bool Idle() const { return state_ == 0; }
+
+  std::vector<LpcFrame> frames_;
+  std::vector<LpcCycle> cycles_;
+  // null keeps every cycle
+  const LpcCycleFilter* filter_{};
+  // taken (and cleared) by whoever commits the cycles
+  LpcDecoderCounts counts_{};
+
+  // index into the state table, see LpcDecoder.cpp
+  U8 state_{};
+  U8 start_code_{};
+  U64 start_sample_{};
+  U64 field_start_{};
+  U64 field_value_{};
+  U64 last_fall_{};
+  U32 cycle_num_frames_{};
+  // bytes left in a FW data run or DMA transfer, and whether the low nibble
+  // of a FW data byte was read
+  U32 run_left_{};
+  bool run_high_{};
+};
@@ -0,0 +1,339 @@
+#include "LpcDiff.h"
+#include <algorithm>
+
+// anchors are runs of this many transactions, then single ones
+static constexpr size_t kWindows[] = {8, 1};
+// gaps without anchors are aligned exactly if they differ by at most this
+// many removed and inserted transactions, and just lined up beyond
+static constexpr size_t kMaxEdits = 2048;
+// for the rolling hash of a run
+static constexpr U64 kRollingBase = 0x100000001b3;
+
+static U64 Mix(U64 x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111eb;
+  return x ^ (x >> 31);
+}
+
+U64 LpcTransactionHash(const LpcTransactionTable& t, size_t i) {
+  const U64 what = (U64)t.start_code[i] | (U64)t.cyctype[i] << 8 |
+                   (U64)t.data_bytes[i] << 16 | (U64)t.sync[i] << 24 |
+                   (U64)(t.flags[i] & kCycleAborted) << 32 |
+                   (U64)t.has_address[i] << 40;
+  const U64 where = (U64)t.address[i] | (U64)t.data[i] << 32;
+  return Mix(where ^ Mix(what));
+}
+
+class TransactionDiffer {
+ public:
+  TransactionDiffer(std::vector<U64> a, std::vector<U64> b)
+      : a_(std::move(a)), b_(std::move(b)) {}
+
+  std::vector<LpcDiffOp> Run();
+
+ private:
+  // a_[a_lo, a_hi) against b_[b_lo, b_hi), |same| if they are known to match
+  struct Range {
+    size_t a_lo;
+    size_t a_hi;
+    size_t b_lo;
+    size_t b_hi;
+    bool same;
+  };
+  struct Anchor {
+    size_t a;
+    size_t b;
+  };
+
+  void Align(Range r);
+  std::vector<Anchor> FindAnchors(const Range& r, size_t window) const;
+  void AlignExact(const Range& r);
+
+  void Same(U64 n);
+  void Removed(U64 n) { removed_ += n; }
+  void Inserted(U64 n) { inserted_ += n; }
+  // pairs up the removed and inserted since the last Same()
+  void Flush();
+
+  std::vector<U64> a_;
+  std::vector<U64> b_;
+  // ranges still to do, the next one last
+  std::vector<Range> todo_;
+  std::vector<LpcDiffOp> ops_;
+  // where the removed and inserted runs start
+  U64 a_pos_{};
+  U64 b_pos_{};
+  U64 removed_{};
+  U64 inserted_{};
+};
+
+std::vector<LpcDiffOp> TransactionDiffer::Run() {
+  todo_.push_back({0, a_.size(), 0, b_.size(), false});
+  while (!todo_.empty()) {
+    const Range r = todo_.back();
+    todo_.pop_back();
+    if (r.same) {
+      Same(r.a_hi - r.a_lo);
+    } else {
+      Align(r);
+    }
+  }
+  Flush();
+  return std::move(ops_);
+}
+
+void TransactionDiffer::Align(Range r) {
+  size_t prefix = 0;
+  while (r.a_lo + prefix < r.a_hi && r.b_lo + prefix < r.b_hi &&
+         a_[r.a_lo + prefix] == b_[r.b_lo + prefix]) {
+    prefix++;
+  }
+  Same(prefix);
+  r.a_lo += prefix;
+  r.b_lo += prefix;
+  size_t suffix = 0;
+  while (r.a_hi - suffix > r.a_lo && r.b_hi - suffix > r.b_lo &&
+         a_[r.a_hi - suffix - 1] == b_[r.b_hi - suffix - 1]) {
+    suffix++;
+  }
+  if (suffix > 0) {
+    todo_.push_back({r.a_hi - suffix, r.a_hi, r.b_hi - suffix, r.b_hi, true});
+    r.a_hi -= suffix;
+    r.b_hi -= suffix;
+  }
+  if (r.a_lo == r.a_hi || r.b_lo == r.b_hi) {
+    Removed(r.a_hi - r.a_lo);
+    Inserted(r.b_hi - r.b_lo);
+    return;
+  }
+
+  for (size_t window : kWindows) {
+    const std::vector<Anchor> anchors = FindAnchors(r, window);
+    if (anchors.empty()) {
+      continue;
+    }
+    // anchors next to each other are one same range
+    size_t a_hi = r.a_hi;
+    size_t b_hi = r.b_hi;
+    for (size_t i = anchors.size(); i > 0;) {
+      const Anchor last = anchors[--i];
+      while (i > 0 && anchors[i - 1].a + 1 == anchors[i].a &&
+             anchors[i - 1].b + 1 == anchors[i].b) {
+        i--;
+      }
+      todo_.push_back({last.a + 1, a_hi, last.b + 1, b_hi, false});
+      todo_.push_back(
+          {anchors[i].a, last.a + 1, anchors[i].b, last.b + 1, true});
+      a_hi = anchors[i].a;
+      b_hi = anchors[i].b;
+    }
+    todo_.push_back({r.a_lo, a_hi, r.b_lo, b_hi, false});
+    return;
+  }
+  AlignExact(r);
+}
+
+std::vector<TransactionDiffer::Anchor> TransactionDiffer::FindAnchors(
+    const Range& r,
+    size_t window) const {
+  if (r.a_hi - r.a_lo < window || r.b_hi - r.b_lo < window) {
+    return {};
+  }
+  U64 top = 1;
+  for (size_t i = 1; i < window; i++) {
+    top *= kRollingBase;
+  }
+  // hash of every run, and where it starts: position << 1 | in b
+  std::vector<std::pair<U64, U64>> runs;
+  runs.reserve(r.a_hi - r.a_lo + r.b_hi - r.b_lo);
+  auto add_runs = [&](const std::vector<U64>& x, size_t lo, size_t hi,
+                      U64 side) {
+    U64 h = 0;
+    for (size_t i = lo; i < lo + window; i++) {
+      h = h * kRollingBase + x[i];
+    }
+    runs.push_back({h, lo << 1 | side});
+    for (size_t i = lo + 1; i + window <= hi; i++) {
+      h = (h - x[i - 1] * top) * kRollingBase + x[i + window - 1];
+      runs.push_back({h, i << 1 | side});
+    }
+  };
+  add_runs(a_, r.a_lo, r.a_hi, 0);
+  add_runs(b_, r.b_lo, r.b_hi, 1);
+  std::sort(runs.begin(), runs.end());
+
+  // b position of the anchor starting at each a position, in a order
+  static constexpr size_t kNoAnchor = ~(size_t)0;
+  std::vector<size_t> anchor_b(r.a_hi - r.a_lo, kNoAnchor);
+  size_t num_anchors = 0;
+  for (size_t i = 0; i < runs.size();) {
+    size_t j = i + 1;
+    while (j < runs.size() && runs[j].first == runs[i].first) {
+      j++;
+    }
+    if (j - i == 2 && (runs[i].second & 1) != (runs[i + 1].second & 1)) {
+      const bool b_first = runs[i].second & 1;
+      const size_t a = runs[b_first ? i + 1 : i].second >> 1;
+      const size_t b = runs[b_first ? i : i + 1].second >> 1;
+      // the run hash could collide, the first transaction mustn't
+      if (a_[a] == b_[b]) {
+        anchor_b[a - r.a_lo] = b;
+        num_anchors++;
+      }
+    }
+    i = j;
+  }
+  if (num_anchors == 0) {
+    return {};
+  }
+  std::vector<Anchor> anchors;
+  anchors.reserve(num_anchors);
+  for (size_t i = 0; i < anchor_b.size(); i++) {
+    if (anchor_b[i] != kNoAnchor) {
+      anchors.push_back({r.a_lo + i, anchor_b[i]});
+    }
+  }
+
+  // longest chain with b in order too (patience sorting)
+  // tails[k]: the anchor ending the best chain of k + 1 found so far
+  std::vector<size_t> tails;
+  std::vector<size_t> prev(anchors.size());
+  for (size_t i = 0; i < anchors.size(); i++) {
+    // mostly in order already, then it extends the longest
+    auto it = tails.end();
+    if (!tails.empty() && anchors[tails.back()].b >= anchors[i].b) {
+      it = std::lower_bound(
+          tails.begin(), tails.end(), anchors[i].b,
+          [&](size_t t, size_t b) { return anchors[t].b < b; });
+    }
+    prev[i] = it == tails.begin() ? ~(size_t)0 : *(it - 1);
+    if (it == tails.end()) {
+      tails.push_back(i);
+    } else {
+      *it = i;
+    }
+  }
+  std::vector<Anchor> chain(tails.size());
+  for (size_t i = tails.back(), k = chain.size(); k > 0; i = prev[i]) {
+    chain[--k] = anchors[i];
+  }
+  return chain;
+}
+
+void TransactionDiffer::AlignExact(const Range& r) {
+  // Myers' greedy diff: v[k] is the furthest x reached on diagonal
+  // k = x - y with d edits. Steps are kept to walk the path back.
+  const size_t n = r.a_hi - r.a_lo;
+  const size_t m = r.b_hi - r.b_lo;
+  const size_t max_edits = std::min<size_t>(n + m, kMaxEdits);
+  const auto a = [&](size_t x) { return a_[r.a_lo + x]; };
+  const auto b = [&](size_t y) { return b_[r.b_lo + y]; };
+  // v of step d at steps[d * d + d + k], for k in [-d, d]
+  std::vector<U32> steps;
+  std::vector<U32> v(2 * max_edits + 3);
+  const ptrdiff_t mid = max_edits + 1;
+  auto down = [](const U32* prev, ptrdiff_t k, ptrdiff_t d) {
+    return k == -d || (k != d && prev[k - 1] < prev[k + 1]);
+  };
+  ptrdiff_t edits = -1;
+  for (ptrdiff_t d = 0; d <= (ptrdiff_t)max_edits && edits < 0; d++) {
+    for (ptrdiff_t k = -d; k <= d; k += 2) {
+      ptrdiff_t x = 0;
+      if (d > 0) {
+        x = down(&v[mid], k, d) ? v[mid + k + 1] : v[mid + k - 1] + 1;
+      }
+      ptrdiff_t y = x - k;
+      while (x < (ptrdiff_t)n && y < (ptrdiff_t)m && a(x) == b(y)) {
+        x++;
+        y++;
+      }
+      v[mid + k] = (U32)x;
+      if (x >= (ptrdiff_t)n && y >= (ptrdiff_t)m) {
+        edits = d;
+      }
+    }
+    steps.insert(steps.end(), v.begin() + mid - d, v.begin() + mid + d + 1);
+  }
+  if (edits < 0) {
+    // too different to be worth lining up
+    Removed(n);
+    Inserted(m);
+    return;
+  }
+
+  // walk back from the end, then emit in order
+  std::vector<std::pair<LpcDiffOp::Kind, U64>> path;
+  ptrdiff_t x = n;
+  ptrdiff_t y = m;
+  for (ptrdiff_t d = edits; d > 0; d--) {
+    const U32* prev = &steps[(d - 1) * (d - 1) + (d - 1)];
+    const ptrdiff_t k = x - y;
+    const bool inserted = down(prev, k, d);
+    const ptrdiff_t prev_k = inserted ? k + 1 : k - 1;
+    const ptrdiff_t prev_x = prev[prev_k];
+    const ptrdiff_t snake_x = inserted ? prev_x : prev_x + 1;
+    path.push_back({LpcDiffOp::kSame, (U64)(x - snake_x)});
+    path.push_back(
+        {inserted ? LpcDiffOp::kInserted : LpcDiffOp::kRemoved, 1});
+    x = prev_x;
+    y = prev_x - prev_k;
+  }
+  path.push_back({LpcDiffOp::kSame, (U64)x});
+  for (auto it = path.rbegin(); it != path.rend(); ++it) {
+    if (it->first == LpcDiffOp::kSame) {
+      Same(it->second);
+    } else if (it->first == LpcDiffOp::kRemoved) {
+      Removed(it->second);
+    } else {
+      Inserted(it->second);
+    }
+  }
+}
+
+void TransactionDiffer::Same(U64 n) {
+  if (n == 0) {
+    return;
+  }
+  Flush();
+  if (!ops_.empty() && ops_.back().kind == LpcDiffOp::kSame) {
+    ops_.back().count += n;
+  } else {
+    ops_.push_back({LpcDiffOp::kSame, a_pos_, b_pos_, n});
+  }
+  a_pos_ += n;
+  b_pos_ += n;
+}
+
+void TransactionDiffer::Flush() {
+  const U64 changed = std::min(removed_, inserted_);
+  if (changed > 0) {
+    ops_.push_back({LpcDiffOp::kChanged, a_pos_, b_pos_, changed});
+  }
+  if (removed_ > changed) {
+    ops_.push_back({LpcDiffOp::kRemoved, a_pos_ + changed, b_pos_ + changed,
+                    removed_ - changed});
+  }
+  if (inserted_ > changed) {
+    ops_.push_back({LpcDiffOp::kInserted, a_pos_ + changed, b_pos_ + changed,
+                    inserted_ - changed});
+  }
+  a_pos_ += removed_;
+  b_pos_ += inserted_;
+  removed_ = 0;
+  inserted_ = 0;
+}
+
+std::vector<LpcDiffOp> DiffTransactions(const LpcTransactionTable& a,
+                                        const LpcTransactionTable& b) {
+  std::vector<U64> a_hashes(a.size());
+  for (size_t i = 0; i < a.size(); i++) {
+    a_hashes[i] = LpcTransactionHash(a, i);
+  }
+  std::vector<U64> b_hashes(b.size());
+  for (size_t i = 0; i < b.size(); i++) {
+    b_hashes[i] = LpcTransactionHash(b, i);
+  }
+  return TransactionDiffer(std::move(a_hashes), std::move(b_hashes)).Run();
+}
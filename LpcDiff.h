@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+#include "LpcTransactions.h"
+
+// Lines up the transactions of two captures, to find where a failing board's
+// boot diverges from a known good one. Transactions are compared by a hash of
+// what they do, not when: two boots never have the same timing.
+
+// A run of transactions. Changed ones are paired up, a[a..a+count) with
+// b[b..b+count); removed ones are only in a, inserted ones only in b, and the
+// other side's index is where they would have been.
+struct LpcDiffOp {
+  enum Kind : U8 { kSame, kChanged, kRemoved, kInserted };
+  Kind kind;
+  U64 a;
+  U64 b;
+  U64 count;
+};
+
+// START, cycle type, address, the first 4 DATA bytes, final SYNC and whether
+// it was aborted. Not the samples or SYNC wait clocks.
+U64 LpcTransactionHash(const LpcTransactionTable& t, size_t i);
+
+// Anchored ("patience") diff: runs of 8 transactions found once in a and
+// once in b are matched up, keeping the longest chain of them in order. The
+// gaps between are done the same way, then with single transactions as
+// anchors, and small gaps left without any are aligned exactly. Close to
+// linear on boot traces, where most cycles are either the same in both or
+// unique (firmware fetches, POST codes).
+std::vector<LpcDiffOp> DiffTransactions(const LpcTransactionTable& a,
+                                        const LpcTransactionTable& b);
@@ -0,0 +1,442 @@
+#include "LpcDissectors.h"
+#include <algorithm>
+#include <iterator>
+
+// Layout of data2 in a dissected DATA frame
+//   0..31   address
+//   32..47  info
+//   48      write
+//   49      io
+//   56..63  dissector id, 0 if not dissected
+static constexpr U32 kInfoShift = 32;
+static constexpr U32 kWriteBit = 48;
+static constexpr U32 kIoBit = 49;
+static constexpr U32 kIdShift = 56;
+
+// TPM cycles are taken as accesses to the MMIO window
+static constexpr U32 kTpmWindow = 0xfed40000;
+
+static void AppendHex(std::string* text, U32 value, int digits) {
+  static constexpr char kDigits[] = "0123456789abcdef";
+  for (int i = digits - 1; i >= 0; i--) {
+    text->push_back(kDigits[value >> (i * 4) & 0xf]);
+  }
+}
+
+// Names for the set bits of |value|, most significant first.
+static void AppendBits(std::string* text,
+                       U8 value,
+                       const std::array<const char*, 8>& names) {
+  for (int i = 7; i >= 0; i--) {
+    if ((value >> i & 1) && names[i] != nullptr) {
+      *text += ' ';
+      *text += names[i];
+    }
+  }
+}
+
+struct NamedValue {
+  U8 value;
+  const char* name;
+};
+
+template <size_t N>
+static const char* Lookup(const NamedValue (&names)[N], U8 value) {
+  for (auto& n : names) {
+    if (n.value == value) {
+      return n.name;
+    }
+  }
+  return nullptr;
+}
+
+// POST codes written to port 0x80 by the firmware during boot
+class PostCodeDissector : public LpcDissector {
+ public:
+  bool Dissect(const LpcAccess& access, U16* info) override {
+    *info = 0;
+    return access.write;
+  }
+  void Describe(const LpcAccess& access,
+                U16,
+                std::string* text) const override {
+    *text += "POST ";
+    AppendHex(text, access.value, 2);
+  }
+};
+
+// SuperIO config space through an index/data port pair (0x2e/0x2f or
+// 0x4e/0x4f). Registers 0x30 and up belong to the selected logical device.
+class SuperIoDissector : public LpcDissector {
+ public:
+  bool Dissect(const LpcAccess& access, U16* info) override {
+    const size_t pair = (access.address & ~1u) == 0x4e ? 1 : 0;
+    if (!(access.address & 1)) {
+      if (access.write) {
+        index_[pair] = access.value;
+      }
+      *info = 0;
+      return true;
+    }
+    const U8 index = index_[pair];
+    if (access.write && index == 0x07) {
+      ldn_[pair] = access.value;
+    }
+    *info = index | ldn_[pair] << 8;
+    return true;
+  }
+  void Describe(const LpcAccess& access,
+                U16 info,
+                std::string* text) const override {
+    static constexpr NamedValue kKeys[] = {
+        {0x87, "enter config"},
+        {0x55, "enter config"},
+        {0xaa, "exit config"},
+    };
+    static constexpr NamedValue kRegisters[] = {
+        {0x02, "config control"}, {0x07, "LDN"},
+        {0x20, "chip id"},        {0x21, "chip rev"},
+        {0x30, "activate"},       {0x60, "base hi"},
+        {0x61, "base lo"},        {0x62, "base2 hi"},
+        {0x63, "base2 lo"},       {0x70, "irq"},
+        {0x71, "irq type"},       {0x74, "dma"},
+    };
+    *text += "SuperIO ";
+    if (!(access.address & 1)) {
+      if (!access.write) {
+        *text += "index";
+        return;
+      }
+      // the enter/exit keys go to the index port too
+      const char* key = Lookup(kKeys, access.value);
+      *text += key != nullptr ? key : "index";
+      return;
+    }
+    const U8 index = (U8)info;
+    const char* name = Lookup(kRegisters, index);
+    if (name != nullptr) {
+      *text += name;
+    } else {
+      *text += "reg ";
+      AppendHex(text, index, 2);
+    }
+    if (index >= 0x30) {
+      *text += " LDN ";
+      AppendHex(text, info >> 8, 2);
+    }
+    *text += access.write ? " <-" : " ->";
+  }
+  void Reset() override {
+    index_ = {};
+    ldn_ = {};
+  }
+
+ private:
+  std::array<U8, 2> index_{};
+  std::array<U8, 2> ldn_{};
+};
+
+// 8042 keyboard controller: data at 0x60, status/command at 0x64. A data
+// byte may belong to the command before it.
+class KbcDissector : public LpcDissector {
+ public:
+  static constexpr U16 kHasCommand = 0x100;
+
+  bool Dissect(const LpcAccess& access, U16* info) override {
+    if (access.address == 0x64) {
+      if (access.write) {
+        command_ = access.value | kHasCommand;
+      }
+      *info = 0;
+      return true;
+    }
+    *info = command_;
+    command_ = 0;
+    return true;
+  }
+  void Describe(const LpcAccess& access,
+                U16 info,
+                std::string* text) const override {
+    static constexpr NamedValue kCommands[] = {
+        {0x20, "read command byte"},  {0x60, "write command byte"},
+        {0xa7, "disable aux"},        {0xa8, "enable aux"},
+        {0xa9, "test aux"},           {0xaa, "self test"},
+        {0xab, "test kbd"},           {0xad, "disable kbd"},
+        {0xae, "enable kbd"},         {0xd0, "read output port"},
+        {0xd1, "write output port"},  {0xd2, "write kbd output"},
+        {0xd3, "write aux output"},   {0xd4, "write to aux"},
+        {0xfe, "pulse reset"},
+    };
+    static constexpr std::array<const char*, 8> kStatus = {
+        "OBF", "IBF", "SYS", "A2", "INH", "AUXB", "TO", "PERR"};
+    *text += "KBC ";
+    if (access.address == 0x64) {
+      if (access.write) {
+        const char* name = Lookup(kCommands, access.value);
+        *text += name != nullptr ? name : "command";
+      } else {
+        *text += "status";
+        AppendBits(text, access.value, kStatus);
+      }
+      return;
+    }
+    const char* name =
+        info & kHasCommand ? Lookup(kCommands, (U8)info) : nullptr;
+    *text += access.write ? "data <-" : "data ->";
+    if (name != nullptr) {
+      *text += " (";
+      *text += name;
+      *text += ')';
+    }
+  }
+  void Reset() override { command_ = 0; }
+
+ private:
+  U16 command_{};
+};
+
+// TIS registers of the TPM, 0xfed40000 + locality * 0x1000
+class TpmDissector : public LpcDissector {
+ public:
+  bool Dissect(const LpcAccess&, U16* info) override {
+    *info = 0;
+    return true;
+  }
+  void Describe(const LpcAccess& access,
+                U16,
+                std::string* text) const override {
+    static constexpr struct {
+      U16 first;
+      U16 last;
+      const char* name;
+    } kRegisters[] = {
+        {0x000, 0x000, "ACCESS"},
+        {0x008, 0x00b, "INT_ENABLE"},
+        {0x00c, 0x00c, "INT_VECTOR"},
+        {0x010, 0x013, "INT_STATUS"},
+        {0x014, 0x017, "INTF_CAPABILITY"},
+        {0x018, 0x018, "STS"},
+        {0x019, 0x01a, "STS.burstCount"},
+        {0x01b, 0x01b, "STS"},
+        {0x024, 0x027, "DATA_FIFO"},
+        {0x030, 0x033, "INTERFACE_ID"},
+        {0x080, 0x083, "XDATA_FIFO"},
+        {0xf00, 0xf03, "DID_VID"},
+        {0xf04, 0xf04, "RID"},
+    };
+    static constexpr std::array<const char*, 8> kAccess = {
+        "tpmEstablishment", "requestUse",     "pendingRequest",
+        "Seize",            "beenSeized",     "activeLocality",
+        nullptr,            "tpmRegValidSts"};
+    static constexpr std::array<const char*, 8> kSts = {
+        nullptr,     "responseRetry", "selfTestDone", "Expect",
+        "dataAvail", "tpmGo",         "commandReady", "stsValid"};
+    const U16 reg = access.address & 0xfff;
+    *text += "TPM loc";
+    AppendHex(text, access.address >> 12 & 0xf, 1);
+    *text += ' ';
+    auto it = std::find_if(
+        std::begin(kRegisters), std::end(kRegisters),
+        [&](auto& r) { return reg >= r.first && reg <= r.last; });
+    if (it == std::end(kRegisters)) {
+      AppendHex(text, reg, 3);
+      return;
+    }
+    *text += it->name;
+    if (reg == 0x000) {
+      AppendBits(text, access.value, kAccess);
+    } else if (reg == 0x018) {
+      AppendBits(text, access.value, kSts);
+    }
+  }
+};
+
+// ACPI embedded controller: data at 0x62, status/command at 0x66
+class EcDissector : public LpcDissector {
+ public:
+  bool Dissect(const LpcAccess& access, U16* info) override {
+    if (access.address == 0x66) {
+      if (access.write) {
+        command_ = access.value;
+        step_ = 0;
+      }
+      *info = 0;
+      return true;
+    }
+    *info = command_ | step_ << 8;
+    if (step_ < 0xff) {
+      step_++;
+    }
+    return true;
+  }
+  void Describe(const LpcAccess& access,
+                U16 info,
+                std::string* text) const override {
+    static constexpr NamedValue kCommands[] = {
+        {0x80, "RD_EC"}, {0x81, "WR_EC"}, {0x82, "BE_EC"},
+        {0x83, "BD_EC"}, {0x84, "QR_EC"},
+    };
+    static constexpr std::array<const char*, 8> kStatus = {
+        "OBF", "IBF", nullptr, "CMD", "BURST", "SCI_EVT", "SMI_EVT", nullptr};
+    *text += "EC ";
+    if (access.address == 0x66) {
+      if (access.write) {
+        const char* name = Lookup(kCommands, access.value);
+        *text += name != nullptr ? name : "command";
+      } else {
+        *text += "status";
+        AppendBits(text, access.value, kStatus);
+      }
+      return;
+    }
+    const U8 command = (U8)info;
+    const U8 step = info >> 8;
+    if ((command == 0x80 || command == 0x81) && step == 0) {
+      *text += "address";
+    } else if ((command == 0x80 || command == 0x81) && step == 1) {
+      *text += "value";
+    } else if (command == 0x84 && !access.write) {
+      *text += "query event";
+    } else {
+      *text += "data";
+    }
+    *text += access.write ? " <-" : " ->";
+  }
+  void Reset() override {
+    command_ = 0;
+    step_ = 0;
+  }
+
+ private:
+  U8 command_{};
+  U8 step_{};
+};
+
+LpcDissectorRegistry::LpcDissectorRegistry() : io_(1 << 16) {}
+
+bool LpcDissectorRegistry::Add(std::shared_ptr<LpcDissector> dissector,
+                               U8* id) {
+  auto it = std::find(dissectors_.begin(), dissectors_.end(), dissector);
+  if (it == dissectors_.end()) {
+    if (dissectors_.size() == 0xff) {
+      return false;
+    }
+    it = dissectors_.insert(it, std::move(dissector));
+  }
+  *id = (U8)(it - dissectors_.begin() + 1);
+  return true;
+}
+
+bool LpcDissectorRegistry::AddIo(U16 first,
+                                 U16 last,
+                                 std::shared_ptr<LpcDissector> dissector) {
+  if (std::any_of(io_.begin() + first, io_.begin() + last + 1,
+                  [](U8 id) { return id != 0; })) {
+    return false;
+  }
+  U8 id;
+  if (!Add(std::move(dissector), &id)) {
+    return false;
+  }
+  std::fill(io_.begin() + first, io_.begin() + last + 1, id);
+  return true;
+}
+
+bool LpcDissectorRegistry::AddMemory(U32 first,
+                                     U32 last,
+                                     std::shared_ptr<LpcDissector> dissector) {
+  for (U32 page = first >> 12; page <= last >> 12; page++) {
+    const auto& table = memory_[page >> 10];
+    if (table && (*table)[page & 0x3ff] != 0) {
+      return false;
+    }
+  }
+  U8 id;
+  if (!Add(std::move(dissector), &id)) {
+    return false;
+  }
+  for (U32 page = first >> 12; page <= last >> 12; page++) {
+    auto& table = memory_[page >> 10];
+    if (!table) {
+      table = std::make_unique<std::array<U8, 1024>>();
+    }
+    (*table)[page & 0x3ff] = id;
+  }
+  return true;
+}
+
+void LpcDissectorRegistry::AddDefaults() {
+  AddIo(0x80, 0x80, std::make_shared<PostCodeDissector>());
+  auto superio = std::make_shared<SuperIoDissector>();
+  AddIo(0x2e, 0x2f, superio);
+  AddIo(0x4e, 0x4f, superio);
+  auto kbc = std::make_shared<KbcDissector>();
+  AddIo(0x60, 0x60, kbc);
+  AddIo(0x64, 0x64, kbc);
+  auto ec = std::make_shared<EcDissector>();
+  AddIo(0x62, 0x62, ec);
+  AddIo(0x66, 0x66, ec);
+  AddMemory(kTpmWindow, kTpmWindow + 0x4fff, std::make_shared<TpmDissector>());
+}
+
+void LpcDissectorRegistry::Reset() {
+  for (auto& d : dissectors_) {
+    d->Reset();
+  }
+}
+
+void LpcDissectorRegistry::Process(LpcDecoder& decoder) {
+  LpcFrame* frames = decoder.frames_.data();
+  for (auto& cycle : decoder.cycles_) {
+    LpcFrame* f = frames;
+    frames += cycle.num_frames;
+    if ((cycle.flags & kCycleAborted) ||
+        (cycle.start_code != kStart && cycle.start_code != kTpmStart)) {
+      continue;
+    }
+    U8 cyctype = 0xff;
+    U32 address = 0;
+    bool has_address = false;
+    LpcFrame* data = nullptr;
+    for (U32 i = 0; i < cycle.num_frames; i++) {
+      if (f[i].type == kCYCTYPE_DIR) {
+        cyctype = (U8)f[i].data1;
+      } else if (f[i].type == kADDR) {
+        address = (U32)f[i].data1;
+        has_address = true;
+      } else if (f[i].type == kDATA && data == nullptr) {
+        data = &f[i];
+      }
+    }
+    if (data == nullptr || !has_address || cyctype > kMemWrite) {
+      continue;
+    }
+    LpcAccess access{address, (U8)data->data1,
+                     cyctype == kIoWrite || cyctype == kMemWrite,
+                     cyctype == kIoRead || cyctype == kIoWrite};
+    if (cycle.start_code == kTpmStart) {
+      access.address = kTpmWindow | (address & 0xffff);
+      access.io = false;
+    }
+    const U8 id = FindId(access.io, access.address);
+    U16 info;
+    if (id == 0 || !dissectors_[id - 1]->Dissect(access, &info)) {
+      continue;
+    }
+    data->data2 = access.address | (U64)info << kInfoShift |
+                  (U64)access.write << kWriteBit | (U64)access.io << kIoBit |
+                  (U64)id << kIdShift;
+  }
+}
+
+void LpcDissectorRegistry::Describe(U64 data1,
+                                    U64 data2,
+                                    std::string* text) const {
+  const U8 id = data2 >> kIdShift;
+  if (id == 0 || id > dissectors_.size()) {
+    return;
+  }
+  const LpcAccess access{(U32)data2, (U8)data1, (data2 >> kWriteBit & 1) != 0,
+                         (data2 >> kIoBit & 1) != 0};
+  dissectors_[id - 1]->Describe(access, (U16)(data2 >> kInfoShift), text);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+#include "LpcDecoder.h"
+
+// Dissectors know what the bytes going to some IO or memory range mean (POST
+// codes, SuperIO config, KBC, TPM registers, EC). They are attached to
+// address ranges in an LpcDissectorRegistry. It looks up every completed IO
+// and memory cycle in flat tables, so the cost per cycle is the same however
+// many dissectors there are.
+//
+// A dissected access is kept in its DATA frame: data1 is the value as
+// always, data2 says which dissector took it and what it made of it (see
+// LpcDissectorRegistry::Process). Text is only made when it's shown.
+
+struct LpcAccess {
+  U32 address;
+  U8 value;
+  bool write;
+  // else memory. TPM cycles (START 0101) are memory accesses to the TPM
+  // window, like their MMIO counterparts.
+  bool io;
+};
+
+class LpcDissector {
+ public:
+  virtual ~LpcDissector() = default;
+  // Cycles are passed in capture order. Returns false to leave the access
+  // alone, or true with |info| to keep for Describe().
+  virtual bool Dissect(const LpcAccess& access, U16* info) = 0;
+  // Only from |access| and |info|: it runs on another thread, at any time.
+  virtual void Describe(const LpcAccess& access,
+                        U16 info,
+                        std::string* text) const = 0;
+  // The capture starts over.
+  virtual void Reset() {}
+};
+
+class LpcDissectorRegistry {
+ public:
+  LpcDissectorRegistry();
+
+  // Ranges are inclusive. Memory ranges are dispatched by 4 KB page, so they
+  // are widened to whole pages; the dissector still sees exact addresses.
+  // Returns false if the range is taken, already or by too many
+  // dissectors.
+  bool AddIo(U16 first, U16 last, std::shared_ptr<LpcDissector> dissector);
+  bool AddMemory(U32 first, U32 last, std::shared_ptr<LpcDissector> dissector);
+  // POST codes, SuperIO config ports, KBC, TPM MMIO and ACPI EC
+  void AddDefaults();
+
+  LpcDissector* Find(bool io, U32 address) const {
+    const U8 id = FindId(io, address);
+    return id != 0 ? dissectors_[id - 1].get() : nullptr;
+  }
+
+  void Reset();
+  // Dissects every completed cycle in |decoder|, in order, so like the TPM
+  // reassembly it runs at commit time.
+  void Process(LpcDecoder& decoder);
+  // Appends the dissector's text for a DATA frame, if it has any.
+  void Describe(U64 data1, U64 data2, std::string* text) const;
+
+ private:
+  bool Add(std::shared_ptr<LpcDissector> dissector, U8* id);
+  // 0 if none
+  U8 FindId(bool io, U32 address) const {
+    if (io) {
+      return io_[(U16)address];
+    }
+    const auto& table = memory_[address >> 22];
+    return table ? (*table)[address >> 12 & 0x3ff] : 0;
+  }
+
+  // id - 1, ids fit in a U8
+  std::vector<std::shared_ptr<LpcDissector>> dissectors_;
+  std::vector<U8> io_;
+  // by page, in 1024 page tables allocated when used
+  std::array<std::unique_ptr<std::array<U8, 1024>>, 1024> memory_;
+};
@@ -0,0 +1,634 @@
+#include "LpcExport.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+#include "LpcShadowMemory.h"
+
+static constexpr char kDigits[] = "0123456789abcdef";
+
+static constexpr auto kHexPairs = [] {
+  std::array<std::array<char, 2>, 256> t{};
+  for (size_t i = 0; i < t.size(); i++) {
+    t[i] = {kDigits[i >> 4], kDigits[i & 0xf]};
+  }
+  return t;
+}();
+
+static constexpr auto kDecPairs = [] {
+  std::array<std::array<char, 2>, 100> t{};
+  for (size_t i = 0; i < t.size(); i++) {
+    t[i] = {kDigits[i / 10], kDigits[i % 10]};
+  }
+  return t;
+}();
+
+// indexed by the 4 bit value, null for unknown ones
+static constexpr auto kStartNames = [] {
+  std::array<const char*, 16> names{};
+  names[kStart] = "Start";
+  names[kTpmStart] = "TPM";
+  names[kFwRead] = "FW Read";
+  names[kFwWrite] = "FW Write";
+  names[kStop] = "Stop";
+  return names;
+}();
+static constexpr auto kSyncNames = [] {
+  std::array<const char*, 16> names{};
+  names[kReady] = "Ready";
+  names[kShortWait] = "ShortWait";
+  names[kLongWait] = "LongWait";
+  names[kReadyMore] = "ReadyMore";
+  names[kError] = "Error";
+  return names;
+}();
+
+const char* StartName(U8 start) {
+  return start < kStartNames.size() ? kStartNames[start] : nullptr;
+}
+
+const char* CycleTypeName(U8 cyctype) {
+  static constexpr const char* kNames[] = {
+      "IO Read", "IO Write", "Mem Read", "Mem Write", "DMA Read", "DMA Write",
+  };
+  return cyctype < std::size(kNames) ? kNames[cyctype] : nullptr;
+}
+
+const char* SyncName(U8 sync) {
+  return sync < kSyncNames.size() ? kSyncNames[sync] : nullptr;
+}
+
+const char* FieldName(FieldType field) {
+  static constexpr const char* kNames[] = {
+      "START", "CYCTYPE_DIR", "SIZE",  "TAR",   "ADDR", "CHANNEL",
+      "DATA",  "SYNC",        "IDSEL", "MSIZE", "TPM",  "CYCLE",
+  };
+  return field < std::size(kNames) ? kNames[field] : nullptr;
+}
+
+LpcTextWriter::LpcTextWriter() : buffer_(new char[kBufferSize]) {}
+
+LpcTextWriter::~LpcTextWriter() {
+  Close();
+}
+
+bool LpcTextWriter::Open(const char* path) {
+  Close();
+  file_ = std::fopen(path, "wb");
+  failed_ = file_ == nullptr;
+  return file_ != nullptr;
+}
+
+bool LpcTextWriter::Close() {
+  if (file_ == nullptr) {
+    return !failed_;
+  }
+  Flush();
+  if (std::fclose(file_) != 0) {
+    failed_ = true;
+  }
+  file_ = nullptr;
+  return !failed_;
+}
+
+void LpcTextWriter::Flush() {
+  WriteDirect({buffer_.get(), pos_});
+  pos_ = 0;
+}
+
+void LpcTextWriter::WriteDirect(std::string_view s) {
+  if (file_ != nullptr && !s.empty() &&
+      std::fwrite(s.data(), 1, s.size(), file_) != s.size()) {
+    failed_ = true;
+  }
+}
+
+void LpcTextWriter::Hex8(U8 value) {
+  Reserve(2);
+  buffer_[pos_] = kHexPairs[value][0];
+  buffer_[pos_ + 1] = kHexPairs[value][1];
+  pos_ += 2;
+}
+
+void LpcTextWriter::Hex(U64 value, size_t min_digits) {
+  const size_t digits = std::max<size_t>(
+      min_digits, std::max<size_t>(1, (std::bit_width(value) + 3) / 4));
+  Reserve(digits);
+  char* p = buffer_.get() + pos_ + digits;
+  for (size_t i = 0; i < digits; i++, value >>= 4) {
+    *--p = kDigits[value & 0xf];
+  }
+  pos_ += digits;
+}
+
+void LpcTextWriter::Dec(U64 value) {
+  char tmp[20];
+  char* p = tmp + sizeof(tmp);
+  while (value >= 100) {
+    p -= 2;
+    std::copy_n(kDecPairs[value % 100].data(), 2, p);
+    value /= 100;
+  }
+  if (value >= 10) {
+    p -= 2;
+    std::copy_n(kDecPairs[value].data(), 2, p);
+  } else {
+    *--p = kDigits[value];
+  }
+  Write({p, (size_t)(tmp + sizeof(tmp) - p)});
+}
+
+void LpcTextWriter::Bin(U64 value, size_t min_digits) {
+  const size_t digits = std::max<size_t>(
+      min_digits, std::max<size_t>(1, std::bit_width(value)));
+  Reserve(digits);
+  char* p = buffer_.get() + pos_ + digits;
+  for (size_t i = 0; i < digits; i++, value >>= 1) {
+    *--p = '0' + (value & 1);
+  }
+  pos_ += digits;
+}
+
+void LpcTextWriter::Number(U64 value, DisplayBase base) {
+  switch (base) {
+  case Binary:
+    Bin(value);
+    break;
+  case Decimal:
+    Dec(value);
+    break;
+  case Hexadecimal:
+  default:
+    Hex(value);
+    break;
+  }
+}
+
+void LpcTextWriter::Name(const char* name, std::string_view prefix, U8 value) {
+  if (name != nullptr) {
+    Write(name);
+  } else {
+    Write(prefix);
+    Bin(value);
+  }
+}
+
+// Calls fn(transaction index) for every transaction, with progress updates.
+template <typename Fn>
+static bool ForEachTransaction(const LpcExportSource& src,
+                               const LpcExportProgress& progress,
+                               Fn&& fn) {
+  // often enough for the progress bar, rarely enough to not matter
+  constexpr size_t kProgressInterval = 1 << 12;
+  const size_t n = src.transactions->size();
+  for (size_t i = 0; i < n; i++) {
+    fn(i);
+    if (i % kProgressInterval == 0 && progress(i, n)) {
+      return false;
+    }
+  }
+  progress(n, n);
+  return true;
+}
+
+bool ExportMergedText(LpcTextWriter& out,
+                      const LpcExportSource& src,
+                      DisplayBase base,
+                      const LpcExportProgress& progress) {
+  const auto& t = *src.transactions;
+  // Attempt to merge transactions of the same type with sequential addresses
+  bool open = false;
+  U8 merged_cyctype = 0;
+  U64 merged_addr = 0;
+  U64 merged_count = 0;
+  bool ok = ForEachTransaction(src, progress, [&](size_t i) {
+    if (t.cyctype[i] == LpcTransaction::kNone || !t.has_address[i] ||
+        t.data_bytes[i] == 0) {
+      return;
+    }
+    const U8 data = (U8)t.data[i];
+    if (open && merged_cyctype == t.cyctype[i] &&
+        merged_addr + merged_count == t.address[i]) {
+      out.Char(' ');
+      out.Hex8(data);
+      merged_count++;
+      return;
+    }
+    if (open) {
+      out.Char('\n');
+    }
+    open = true;
+    merged_cyctype = t.cyctype[i];
+    merged_addr = t.address[i];
+    merged_count = 1;
+    out.Name(CycleTypeName(merged_cyctype), "CYCTYPE_DIR:", merged_cyctype);
+    out.Write(" ADDR:");
+    out.Number(merged_addr, base);
+    out.Write(" : ");
+    out.Hex8(data);
+  });
+  // catch any trailing data
+  if (open) {
+    out.Char('\n');
+  }
+  return ok;
+}
+
+bool ExportCycleCsv(LpcTextWriter& out,
+                    const LpcExportSource& src,
+                    DisplayBase base,
+                    const LpcExportProgress& progress) {
+  const auto& t = *src.transactions;
+  // where the next transaction with more than 4 DATA bytes has them
+  size_t long_data = 0;
+  out.Write(
+      "start_sample,end_sample,start,cycle,address,data,sync_waits,sync,"
+      "aborted\n");
+  return ForEachTransaction(src, progress, [&](size_t i) {
+    out.Dec(t.start[i]);
+    out.Char(',');
+    out.Dec(t.end[i]);
+    out.Char(',');
+    out.Name(StartName(t.start_code[i]), "START:", t.start_code[i]);
+    out.Char(',');
+    if (t.cyctype[i] != LpcTransaction::kNone) {
+      out.Name(CycleTypeName(t.cyctype[i]), "CYCTYPE_DIR:", t.cyctype[i]);
+    }
+    out.Char(',');
+    if (t.has_address[i]) {
+      out.Number(t.address[i], base);
+    }
+    out.Char(',');
+    if (t.data_bytes[i] <= 4) {
+      for (U8 b = 0; b < t.data_bytes[i]; b++) {
+        if (b > 0) {
+          out.Char(' ');
+        }
+        out.Hex8((U8)(t.data[i] >> (b * 8)));
+      }
+    } else {
+      for (U8 b = 0; b < t.data_bytes[i]; b++) {
+        if (b > 0) {
+          out.Char(' ');
+        }
+        out.Hex8(t.long_data[long_data++]);
+      }
+    }
+    out.Char(',');
+    out.Dec(t.sync_waits[i]);
+    out.Char(',');
+    if (t.sync[i] != LpcTransaction::kNone) {
+      out.Name(SyncName(t.sync[i]), "SYNC:", t.sync[i]);
+    }
+    out.Char(',');
+    out.Char((t.flags[i] & kCycleAborted) ? '1' : '0');
+    out.Char('\n');
+  });
+}
+
+bool ExportFramesCsv(LpcTextWriter& out,
+                     const LpcExportSource& src,
+                     DisplayBase base,
+                     const LpcExportProgress& progress) {
+  constexpr size_t kProgressInterval = 1 << 14;
+  out.Write("start_sample,end_sample,field,data1,data2,flags\n");
+  for (U64 i = 0; i < src.num_frames; i++) {
+    const LpcFrame f = src.frame(i);
+    out.Dec(f.start);
+    out.Char(',');
+    out.Dec(f.end);
+    out.Char(',');
+    out.Name(FieldName(f.type), "FIELD:", f.type);
+    out.Char(',');
+    out.Number(f.data1, base);
+    out.Char(',');
+    out.Number(f.data2, base);
+    out.Char(',');
+    out.Dec(f.flags);
+    out.Char('\n');
+    if (i % kProgressInterval == 0 && progress(i, src.num_frames)) {
+      return false;
+    }
+  }
+  progress(src.num_frames, src.num_frames);
+  return true;
+}
+
+static U64 Align8(U64 offset) {
+  return (offset + 7) & ~(U64)7;
+}
+
+static void Pad8(LpcTextWriter& out, U64 offset) {
+  static constexpr char kZeros[8]{};
+  out.Bytes(kZeros, Align8(offset) - offset);
+}
+
+// Values are written in host byte order, which is little endian everywhere
+// Logic runs. Most columns are the table's own.
+bool ExportTransactionsBinary(const char* path,
+                              const LpcExportSource& src,
+                              const LpcExportProgress& progress) {
+  const auto& t = *src.transactions;
+  const U64 n = t.size();
+  std::vector<U8> aborted(n);
+  std::vector<U64> long_data(n);
+  U64 long_data_offset = 0;
+  for (U64 i = 0; i < n; i++) {
+    aborted[i] = (t.flags[i] & kCycleAborted) ? 1 : 0;
+    long_data[i] = long_data_offset;
+    if (t.data_bytes[i] > 4) {
+      long_data_offset += t.data_bytes[i];
+    }
+  }
+  struct Column {
+    LpcTransactionColumn id;
+    U32 width;
+    const void* values;
+    U64 count;
+  };
+  const Column columns[] = {
+      {kColumnStart, 8, t.start.data(), n},
+      {kColumnEnd, 8, t.end.data(), n},
+      {kColumnStartCode, 1, t.start_code.data(), n},
+      {kColumnCycleType, 1, t.cyctype.data(), n},
+      {kColumnAddress, 4, t.address.data(), n},
+      {kColumnData, 4, t.data.data(), n},
+      {kColumnDataBytes, 1, t.data_bytes.data(), n},
+      {kColumnSyncWaits, 2, t.sync_waits.data(), n},
+      {kColumnSync, 1, t.sync.data(), n},
+      {kColumnAborted, 1, aborted.data(), n},
+      {kColumnLongDataOffset, 8, long_data.data(), n},
+      {kColumnLongData, 1, t.long_data.data(), t.long_data.size()},
+  };
+
+  LpcTextWriter out;
+  if (!out.Open(path)) {
+    return false;
+  }
+  const U32 version = 2;
+  const U32 num_columns = (U32)std::size(columns);
+  out.Write("LPCTRANS");
+  out.Bytes(&version, sizeof(version));
+  out.Bytes(&num_columns, sizeof(num_columns));
+  out.Bytes(&n, sizeof(n));
+  U64 offset = Align8(24 + 24 * num_columns);
+  for (auto& c : columns) {
+    out.Bytes(&c.id, sizeof(c.id));
+    out.Bytes(&c.width, sizeof(c.width));
+    out.Bytes(&offset, sizeof(offset));
+    out.Bytes(&c.count, sizeof(c.count));
+    offset = Align8(offset + c.width * c.count);
+  }
+  Pad8(out, 24 + 24 * num_columns);
+  for (size_t i = 0; i < std::size(columns); i++) {
+    out.Bytes(columns[i].values, columns[i].width * columns[i].count);
+    Pad8(out, columns[i].width * columns[i].count);
+    if (progress(i, std::size(columns))) {
+      return false;
+    }
+  }
+  if (!out.Close()) {
+    return false;
+  }
+
+  std::vector<std::pair<U32, U64>> index;
+  for (U64 i = 0; i < n; i++) {
+    if (t.has_address[i]) {
+      index.emplace_back(t.address[i], i);
+    }
+  }
+  std::sort(index.begin(), index.end());
+  const U64 num_entries = index.size();
+  const U32 index_version = 1;
+  const U32 reserved = 0;
+  if (!out.Open((std::string(path) + ".idx").c_str())) {
+    return false;
+  }
+  out.Write("LPCTXIDX");
+  out.Bytes(&index_version, sizeof(index_version));
+  out.Bytes(&reserved, sizeof(reserved));
+  out.Bytes(&num_entries, sizeof(num_entries));
+  for (auto& e : index) {
+    out.Bytes(&e.first, sizeof(e.first));
+  }
+  Pad8(out, sizeof(U32) * num_entries);
+  for (auto& e : index) {
+    out.Bytes(&e.second, sizeof(e.second));
+  }
+  progress(std::size(columns), std::size(columns));
+  return out.Close();
+}
+
+bool ExportRomImage(const char* path,
+                    const LpcExportSource& src,
+                    const LpcExportProgress& progress) {
+  constexpr size_t kProgressInterval = 1 << 12;
+  const auto& t = *src.transactions;
+  LpcShadowMemory shadow;
+  size_t long_data = 0;
+  for (size_t i = 0; i < t.size(); i++) {
+    U8 data[4];
+    const U8* bytes = data;
+    if (t.data_bytes[i] > 4) {
+      bytes = t.long_data.data() + long_data;
+      long_data += t.data_bytes[i];
+    } else {
+      for (U8 b = 0; b < 4; b++) {
+        data[b] = (U8)(t.data[i] >> (b * 8));
+      }
+    }
+    shadow.Replay(t[i], bytes);
+    if (i % kProgressInterval == 0 && progress(i, t.size())) {
+      return false;
+    }
+  }
+
+  LpcTextWriter out;
+  if (!out.Open(path)) {
+    return false;
+  }
+  U64 begin = 0;
+  U64 size = 0;
+  shadow.RomImageRange(&begin, &size);
+  std::vector<U8> chunk(LpcShadowSpace::kPageSize * 16);
+  for (U64 done = 0; done < size; done += chunk.size()) {
+    shadow.memory.CopyOut(begin + done, chunk.size(), 0xff, chunk.data());
+    out.Bytes(chunk.data(), chunk.size());
+  }
+  progress(t.size(), t.size());
+  return out.Close();
+}
+
+void ExportLatencyCsv(LpcTextWriter& out,
+                      const LpcLatencyStats& stats,
+                      double sample_rate) {
+  static constexpr double kPercentiles[] = {50, 90, 99, 99.9};
+  const char* unit = sample_rate > 0 ? "ns" : "samples";
+  const double scale = sample_rate > 0 ? 1e9 / sample_rate : 1;
+  char tmp[64];
+  auto histogram = [&](const LpcHistogram& h, double scale) {
+    out.Char(',');
+    std::snprintf(tmp, sizeof(tmp), "%.2f", h.mean() * scale);
+    out.Write(tmp);
+    for (double p : kPercentiles) {
+      out.Char(',');
+      out.Dec((U64)(h.Percentile(p) * scale + .5));
+    }
+    out.Char(',');
+    out.Dec((U64)(h.max() * scale + .5));
+  };
+  auto header = [&](std::string_view name) {
+    for (const char* column : {"mean", "p50", "p90", "p99", "p99.9", "max"}) {
+      out.Char(',');
+      out.Write(name);
+      out.Char('_');
+      out.Write(column);
+    }
+  };
+  out.Write("start,cycle,first_address,last_address,cycles");
+  header("waits");
+  header(std::string("duration_") + unit);
+  out.Char('\n');
+  for (const auto& [key, entry] : stats.entries()) {
+    out.Name(StartName(key.start_code), "START:", key.start_code);
+    out.Char(',');
+    if (key.cyctype != LpcTransaction::kNone) {
+      out.Name(CycleTypeName(key.cyctype), "CYCTYPE_DIR:", key.cyctype);
+    }
+    out.Char(',');
+    out.Hex(key.bucket);
+    out.Char(',');
+    out.Hex(stats.BucketLast(key));
+    out.Char(',');
+    out.Dec(entry.waits.count());
+    histogram(entry.waits, 1);
+    histogram(entry.duration, scale);
+    out.Char('\n');
+  }
+}
+
+void ExportHeatmapCsv(LpcTextWriter& out,
+                      const LpcHeatmap& heatmap,
+                      size_t top_n) {
+  auto line = [&out](const char* kind, LpcHeatmap::Space space, U32 first,
+                     U32 last, U64 reads, U64 writes, U64 bytes, U64 blocks) {
+    out.Write(kind);
+    out.Char(',');
+    out.Write(LpcHeatmap::SpaceName(space));
+    out.Char(',');
+    out.Hex(first);
+    out.Char(',');
+    out.Hex(last);
+    for (U64 value : {reads, writes, bytes, blocks}) {
+      out.Char(',');
+      out.Dec(value);
+    }
+    out.Char('\n');
+  };
+  out.Write("kind,space,first_address,last_address,reads,writes,bytes,"
+            "blocks\n");
+  for (const auto& e : heatmap.Top(top_n)) {
+    line("top", e.space(), e.first(), heatmap.BlockLast(e), e.reads,
+         e.writes, e.bytes, 1);
+  }
+  for (const auto& r : heatmap.Regions()) {
+    line("region", r.space, r.first, r.last, r.reads, r.writes, r.bytes,
+         r.blocks);
+  }
+}
+
+// index,sample,start,cycle,address,data,sync,aborted of |t|[i]
+static void DiffSide(LpcTextWriter& out,
+                     const LpcTransactionTable& t,
+                     size_t i) {
+  out.Dec(i);
+  out.Char(',');
+  out.Dec(t.start[i]);
+  out.Char(',');
+  out.Name(StartName(t.start_code[i]), "START:", t.start_code[i]);
+  out.Char(',');
+  if (t.cyctype[i] != LpcTransaction::kNone) {
+    out.Name(CycleTypeName(t.cyctype[i]), "CYCTYPE_DIR:", t.cyctype[i]);
+  }
+  out.Char(',');
+  if (t.has_address[i]) {
+    out.Hex(t.address[i]);
+  }
+  out.Char(',');
+  for (U8 b = 0; b < std::min<U8>(t.data_bytes[i], 4); b++) {
+    if (b > 0) {
+      out.Char(' ');
+    }
+    out.Hex8((U8)(t.data[i] >> (b * 8)));
+  }
+  out.Char(',');
+  if (t.sync[i] != LpcTransaction::kNone) {
+    out.Name(SyncName(t.sync[i]), "SYNC:", t.sync[i]);
+  }
+  out.Char(',');
+  out.Char((t.flags[i] & kCycleAborted) ? '1' : '0');
+}
+
+void ExportDiffCsv(LpcTextWriter& out,
+                   const LpcTransactionTable& a,
+                   const LpcTransactionTable& b,
+                   const std::vector<LpcDiffOp>& ops) {
+  static constexpr const char* kOpNames[] = {"same", "changed", "removed",
+                                             "inserted"};
+  static constexpr std::string_view kNoSide = ",,,,,,,";
+  out.Write("op");
+  for (const char* side : {"a", "b"}) {
+    for (const char* column : {"index", "sample", "start", "cycle", "address",
+                               "data", "sync", "aborted"}) {
+      out.Char(',');
+      out.Write(side);
+      out.Char('_');
+      out.Write(column);
+    }
+  }
+  out.Char('\n');
+  for (const auto& op : ops) {
+    if (op.kind == LpcDiffOp::kSame) {
+      continue;
+    }
+    for (U64 k = 0; k < op.count; k++) {
+      out.Write(kOpNames[op.kind]);
+      out.Char(',');
+      if (op.kind == LpcDiffOp::kInserted) {
+        out.Write(kNoSide);
+      } else {
+        DiffSide(out, a, op.a + k);
+      }
+      out.Char(',');
+      if (op.kind == LpcDiffOp::kRemoved) {
+        out.Write(kNoSide);
+      } else {
+        DiffSide(out, b, op.b + k);
+      }
+      out.Char('\n');
+    }
+  }
+}
+
+void ExportStats(LpcTextWriter& out, const LpcStats& stats) {
+  out.Write("stat,value,calls\n");
+  for (size_t i = 0; i < kNumCounters; i++) {
+    out.Write(CounterName((LpcCounter)i));
+    out.Char(',');
+    out.Dec(stats.counts[i]);
+    out.Write(",\n");
+  }
+  char ms[32];
+  for (size_t i = 0; i < kNumTimers; i++) {
+    out.Write(TimerName((LpcTimer)i));
+    out.Write("_ms,");
+    std::snprintf(ms, sizeof(ms), "%.3f", stats.ns[i] / 1e6);
+    out.Write(ms);
+    out.Char(',');
+    out.Dec(stats.calls[i]);
+    out.Char('\n');
+  }
+}
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include "LpcDecoder.h"
+#include "LpcDiff.h"
+#include "LpcHeatmap.h"
+#include "LpcLatency.h"
+#include "LpcStats.h"
+#include "LpcTransactions.h"
+
+// Export of decoded cycles, without the SDK. The plugin keeps a transaction
+// table of the committed cycles (see LpcAnalyzerResults), so exporting
+// doesn't go through GetFrame() one frame at a time, except for the frames
+// themselves.
+
+enum LpcExportType : U32 {
+  // transactions with consecutive addresses merged, one line each
+  kExportMergedText,
+  // one line per cycle
+  kExportCycleCsv,
+  // one line per frame
+  kExportFramesCsv,
+  // columnar binary, plus a sorted address index next to it
+  kExportTransactionsBinary,
+  // flash/ROM image rebuilt from the memory and FW cycles
+  kExportRomImage,
+  // SYNC wait and duration percentiles per device
+  kExportLatencyCsv,
+  // decoder counters and stage times, only built with LPC_STATS
+  kExportStats,
+  // most accessed addresses and per region totals
+  kExportHeatmapCsv,
+};
+
+// Names for the protocol values, nullptr if not a known value.
+const char* StartName(U8 start);
+const char* CycleTypeName(U8 cyctype);
+const char* SyncName(U8 sync);
+const char* FieldName(FieldType field);
+
+// Buffered file writer. Numbers are formatted from lookup tables into a large
+// buffer that is written out only when full, so nothing is allocated and
+// nothing is flushed per line.
+class LpcTextWriter {
+ public:
+  static constexpr size_t kBufferSize = 1 << 20;
+
+  LpcTextWriter();
+  ~LpcTextWriter();
+  LpcTextWriter(const LpcTextWriter&) = delete;
+  LpcTextWriter& operator=(const LpcTextWriter&) = delete;
+
+  bool Open(const char* path);
+  // Flushes and closes, returns false if anything failed to write.
+  bool Close();
+
+  void Write(std::string_view s) {
+    if (s.size() > kBufferSize - pos_) {
+      Flush();
+      if (s.size() > kBufferSize) {
+        WriteDirect(s);
+        return;
+      }
+    }
+    s.copy(buffer_.get() + pos_, s.size());
+    pos_ += s.size();
+  }
+  void Bytes(const void* data, size_t n) {
+    Write({(const char*)data, n});
+  }
+  void Char(char c) {
+    Reserve(1);
+    buffer_[pos_++] = c;
+  }
+  // two hex digits
+  void Hex8(U8 value);
+  // without leading zeros, unless at least min_digits
+  void Hex(U64 value, size_t min_digits = 1);
+  void Dec(U64 value);
+  void Bin(U64 value, size_t min_digits = 1);
+  // Binary, Decimal or hex for anything else, like the bubbles
+  void Number(U64 value, DisplayBase base);
+  // |name|, or |prefix| and the value in binary for unknown values
+  void Name(const char* name, std::string_view prefix, U8 value);
+
+ private:
+  void Reserve(size_t n) {
+    if (n > kBufferSize - pos_) {
+      Flush();
+    }
+  }
+  void Flush();
+  void WriteDirect(std::string_view s);
+
+  std::unique_ptr<char[]> buffer_;
+  size_t pos_{};
+  FILE* file_{};
+  bool failed_{};
+};
+
+// Reports progress every so often, returns true to cancel.
+using LpcExportProgress = std::function<bool(U64 done, U64 total)>;
+
+// The transactions (cycles), and the frames as they were shown. Only the
+// frames CSV goes through the frames, one at a time.
+struct LpcExportSource {
+  const LpcTransactionTable* transactions;
+  U64 num_frames;
+  std::function<LpcFrame(U64 index)> frame;
+};
+
+// Returns false if cancelled.
+bool ExportMergedText(LpcTextWriter& out,
+                      const LpcExportSource& src,
+                      DisplayBase base,
+                      const LpcExportProgress& progress);
+bool ExportCycleCsv(LpcTextWriter& out,
+                    const LpcExportSource& src,
+                    DisplayBase base,
+                    const LpcExportProgress& progress);
+bool ExportFramesCsv(LpcTextWriter& out,
+                     const LpcExportSource& src,
+                     DisplayBase base,
+                     const LpcExportProgress& progress);
+
+// Binary transaction export, little endian, version 2:
+//   char magic[8]        "LPCTRANS"
+//   U32 version          2
+//   U32 num_columns
+//   U64 num_transactions
+//   then num_columns of
+//     U32 id             LpcTransactionColumn
+//     U32 width          bytes per value
+//     U64 offset         from the start of the file, 8 byte aligned
+//     U64 count          values in the column
+// Columns are arrays of values, num_transactions of them except for
+// kColumnLongData, so the file can be mapped and used in place. Readers
+// look columns up by id and skip unknown ones: adding columns keeps the
+// version, changing an existing one gets a new id.
+//
+// Version 1 had no count, and no long data columns.
+//
+// <path>.idx lists the transactions which have an address, sorted by
+// address (then by transaction):
+//   char magic[8]        "LPCTXIDX"
+//   U32 version          1
+//   U32 reserved
+//   U64 num_entries
+//   U32 address[num_entries]
+//   padding to 8 bytes
+//   U64 transaction[num_entries]
+// so all accesses to an address are an equal_range() on address[].
+enum LpcTransactionColumn : U32 {
+  kColumnStart = 1,
+  kColumnEnd,
+  kColumnStartCode,
+  kColumnCycleType,
+  kColumnAddress,
+  // the first 4 DATA bytes, the first in the low byte
+  kColumnData,
+  // all of them, up to 255 (FW MSIZE 128, DMA)
+  kColumnDataBytes,
+  kColumnSyncWaits,
+  kColumnSync,
+  kColumnAborted,
+  // U64, where the transaction's DATA bytes start in kColumnLongData. Only
+  // for those with more than 4, kColumnData has the others in full.
+  kColumnLongDataOffset,
+  // U8, the DATA bytes of the transactions with more than 4, in order
+  kColumnLongData,
+};
+
+bool ExportTransactionsBinary(const char* path,
+                              const LpcExportSource& src,
+                              const LpcExportProgress& progress);
+
+// Replays every transaction into an LpcShadowMemory and writes the ROM image
+// it holds (see LpcShadowMemory::RomImageRange), 0xff where nothing was seen.
+bool ExportRomImage(const char* path,
+                    const LpcExportSource& src,
+                    const LpcExportProgress& progress);
+
+// One line per START, cycle type and address bucket of |stats|: cycle count,
+// then mean, percentiles and max of the SYNC wait clocks and of the cycle
+// durations. Durations are in ns, or samples if |sample_rate| is 0.
+void ExportLatencyCsv(LpcTextWriter& out,
+                      const LpcLatencyStats& stats,
+                      double sample_rate);
+
+// The |top_n| most accessed blocks of |heatmap| ("top" lines), then every
+// region with its totals ("region" lines, blocks is how many were accessed).
+void ExportHeatmapCsv(LpcTextWriter& out,
+                      const LpcHeatmap& heatmap,
+                      size_t top_n);
+
+// One line per changed, removed or inserted transaction of |ops|, with its
+// index, START sample and fields in capture a and in b (empty on the side it
+// isn't in). DATA is the first 4 bytes, what the tables keep.
+void ExportDiffCsv(LpcTextWriter& out,
+                   const LpcTransactionTable& a,
+                   const LpcTransactionTable& b,
+                   const std::vector<LpcDiffOp>& ops);
+
+// One line per counter and per stage timer (ms, and how many times it ran).
+void ExportStats(LpcTextWriter& out, const LpcStats& stats);
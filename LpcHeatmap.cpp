@@ -0,0 +1,176 @@
+#include "LpcHeatmap.h"
+#include <algorithm>
+#include <bit>
+#include <map>
+
+// Which space a cycle addresses, false for those without an address.
+static bool SpaceOf(U8 start_code, U8 cyctype, LpcHeatmap::Space* space) {
+  switch (start_code) {
+  case kStart:
+    if (cyctype == kIoRead || cyctype == kIoWrite) {
+      *space = LpcHeatmap::kIo;
+      return true;
+    }
+    if (cyctype == kMemRead || cyctype == kMemWrite) {
+      *space = LpcHeatmap::kMemory;
+      return true;
+    }
+    return false;
+  case kTpmStart:
+    *space = LpcHeatmap::kTpm;
+    return true;
+  case kFwRead:
+  case kFwWrite:
+    *space = LpcHeatmap::kFirmware;
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool IsWrite(U8 start_code, U8 cyctype) {
+  if (start_code == kFwRead || start_code == kFwWrite) {
+    return start_code == kFwWrite;
+  }
+  return cyctype == kIoWrite || cyctype == kMemWrite;
+}
+
+static U32 LowMask(U8 bits) {
+  return bits >= 32 ? ~0u : ~(~0u << bits);
+}
+
+void LpcHeatmap::clear() {
+  entries_.clear();
+  size_ = 0;
+  last_ = 0;
+}
+
+void LpcHeatmap::Add(const LpcTransaction& t) {
+  Space space;
+  if ((t.flags & kCycleAborted) || !t.has_address ||
+      !SpaceOf(t.start_code, t.cyctype, &space)) {
+    return;
+  }
+  Count(space, t.address, IsWrite(t.start_code, t.cyctype), t.data_bytes);
+}
+
+void LpcHeatmap::Add(const LpcTransactionTable& t) {
+  // straight from the columns, without building each LpcTransaction
+  for (size_t i = 0; i < t.size(); i++) {
+    Space space;
+    if ((t.flags[i] & kCycleAborted) || !t.has_address[i] ||
+        !SpaceOf(t.start_code[i], t.cyctype[i], &space)) {
+      continue;
+    }
+    Count(space, t.address[i], IsWrite(t.start_code[i], t.cyctype[i]),
+          t.data_bytes[i]);
+  }
+}
+
+void LpcHeatmap::Count(Space space, U32 address, bool write, U8 bytes) {
+  Entry& e = Find((U64)space << 32 | (address & ~LowMask(block_bits)));
+  if (write) {
+    e.writes++;
+  } else {
+    e.reads++;
+  }
+  e.bytes += bytes;
+}
+
+LpcHeatmap::Entry& LpcHeatmap::Find(U64 key) {
+  if (!entries_.empty() && entries_[last_].key == key) {
+    return entries_[last_];
+  }
+  if ((size_ + 1) * 2 > entries_.size()) {
+    Grow();
+  }
+  const size_t mask = entries_.size() - 1;
+  const int shift = 64 - std::countr_zero(entries_.size());
+  size_t i = (size_t)((key * 0x9e3779b97f4a7c15ull) >> shift);
+  while (entries_[i].key != key) {
+    if (entries_[i].key == kEmpty) {
+      entries_[i] = {key, 0, 0, 0};
+      size_++;
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+  last_ = i;
+  return entries_[i];
+}
+
+void LpcHeatmap::Grow() {
+  std::vector<Entry> old(std::max<size_t>(entries_.size() * 2, 1024),
+                         Entry{kEmpty, 0, 0, 0});
+  old.swap(entries_);
+  const size_t mask = entries_.size() - 1;
+  const int shift = 64 - std::countr_zero(entries_.size());
+  for (const Entry& e : old) {
+    if (e.key == kEmpty) {
+      continue;
+    }
+    size_t i = (size_t)((e.key * 0x9e3779b97f4a7c15ull) >> shift);
+    while (entries_[i].key != kEmpty) {
+      i = (i + 1) & mask;
+    }
+    entries_[i] = e;
+  }
+  last_ = 0;
+}
+
+U32 LpcHeatmap::BlockLast(const Entry& entry) const {
+  return entry.first() | LowMask(block_bits);
+}
+
+std::vector<LpcHeatmap::Entry> LpcHeatmap::Top(size_t n) const {
+  std::vector<Entry> top;
+  top.reserve(size_);
+  for (const Entry& e : entries_) {
+    if (e.key != kEmpty) {
+      top.push_back(e);
+    }
+  }
+  n = std::min(n, top.size());
+  std::partial_sort(top.begin(), top.begin() + n, top.end(),
+                    [](const Entry& a, const Entry& b) {
+                      if (a.accesses() != b.accesses()) {
+                        return a.accesses() > b.accesses();
+                      }
+                      return a.key < b.key;
+                    });
+  top.resize(n);
+  return top;
+}
+
+std::vector<LpcHeatmap::Region> LpcHeatmap::Regions() const {
+  // few enough that a tree keeps them sorted for free
+  std::map<U64, Region> regions;
+  for (const Entry& e : entries_) {
+    if (e.key == kEmpty) {
+      continue;
+    }
+    const U8 bits = std::max<U8>(e.space() == kIo ? 8 : 20, block_bits);
+    const U32 first = e.first() & ~LowMask(bits);
+    auto [it, added] = regions.try_emplace((U64)e.space() << 32 | first);
+    Region& r = it->second;
+    if (added) {
+      r = {e.space(), first, first | LowMask(bits), 0, 0, 0, 0};
+    }
+    r.reads += e.reads;
+    r.writes += e.writes;
+    r.bytes += e.bytes;
+    r.blocks++;
+  }
+  std::vector<Region> sorted;
+  sorted.reserve(regions.size());
+  for (const auto& [key, r] : regions) {
+    sorted.push_back(r);
+  }
+  return sorted;
+}
+
+const char* LpcHeatmap::SpaceName(Space space) {
+  static constexpr const char* kNames[kNumSpaces] = {"io", "memory",
+                                                     "firmware", "tpm"};
+  return space < kNumSpaces ? kNames[space] : "?";
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <vector>
+#include "LpcTransactions.h"
+
+// Reads, writes and bytes per address (or block of addresses) over a whole
+// capture, to find polling loops and firmware fetched more than once. A boot
+// trace has millions of cycles to a few thousand places, so they are counted
+// in a flat open addressing table rather than a tree.
+
+class LpcHeatmap {
+ public:
+  enum Space : U8 { kIo, kMemory, kFirmware, kTpm, kNumSpaces };
+
+  struct Entry {
+    // space << 32 | first address of the block
+    U64 key;
+    U64 reads;
+    U64 writes;
+    // DATA bytes, both ways
+    U64 bytes;
+
+    Space space() const { return (Space)(key >> 32); }
+    U32 first() const { return (U32)key; }
+    U64 accesses() const { return reads + writes; }
+  };
+  struct Region {
+    Space space;
+    U32 first;
+    U32 last;
+    U64 reads;
+    U64 writes;
+    U64 bytes;
+    // blocks accessed at least once
+    U64 blocks;
+  };
+
+  // Addresses are counted per 2^block_bits, 0 counts every address. Set
+  // before adding anything.
+  U8 block_bits{0};
+
+  void clear();
+  // Aborted cycles and those without an address (DMA, bus master) are
+  // skipped.
+  void Add(const LpcTransaction& t);
+  void Add(const LpcTransactionTable& transactions);
+
+  // blocks accessed at least once
+  size_t size() const { return size_; }
+  // last address of the block |entry| starts
+  U32 BlockLast(const Entry& entry) const;
+  // The |n| most accessed blocks, most first. Ties go to the lower address.
+  std::vector<Entry> Top(size_t n) const;
+  // Totals per region: 256 IO ports, 1 MB of anything else (or a block, if
+  // that is larger). Sorted by space and address.
+  std::vector<Region> Regions() const;
+
+  static const char* SpaceName(Space space);
+
+ private:
+  static constexpr U64 kEmpty = ~0ull;
+
+  void Count(Space space, U32 address, bool write, U8 bytes);
+  Entry& Find(U64 key);
+  void Grow();
+
+  // power of two sized, grown past half full
+  std::vector<Entry> entries_;
+  size_t size_{};
+  // consecutive cycles often go to the same block (FW fetches, polling)
+  size_t last_{};
+};
@@ -0,0 +1,71 @@
+#include "LpcLatency.h"
+#include <algorithm>
+
+void LpcHistogram::Merge(const LpcHistogram& other) {
+  if (other.count_ == 0) {
+    return;
+  }
+  if (other.counts_.size() > counts_.size()) {
+    counts_.resize(other.counts_.size());
+  }
+  for (size_t i = 0; i < other.counts_.size(); i++) {
+    counts_[i] += other.counts_[i];
+  }
+  min_ = count_ == 0 ? other.min_ : std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+  count_ += other.count_;
+  sum_ += other.sum_;
+}
+
+U64 LpcHistogram::UpperBound(U32 index) {
+  if (index < kSubBuckets) {
+    return index;
+  }
+  const U32 shift = (index >> kSubBits) - 1;
+  const U64 first = (U64)(kSubBuckets + (index & (kSubBuckets - 1))) << shift;
+  return first + ((U64)1 << shift) - 1;
+}
+
+U64 LpcHistogram::Percentile(double percent) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  // rank of the value, 1-based
+  U64 rank = (U64)(percent / 100 * count_ + .5);
+  rank = std::clamp<U64>(rank, 1, count_);
+  U64 seen = 0;
+  for (size_t i = 0; i < counts_.size(); i++) {
+    seen += counts_[i];
+    if (seen >= rank) {
+      return std::clamp(UpperBound((U32)i), min_, max_);
+    }
+  }
+  return max_;
+}
+
+U8 LpcLatencyStats::BucketBits(U8 start_code, U8 cyctype) const {
+  // TPM cycles address registers in localities, like the MMIO window
+  const bool io =
+      start_code == kStart && (cyctype == kIoRead || cyctype == kIoWrite);
+  return io ? io_bucket_bits : memory_bucket_bits;
+}
+
+void LpcLatencyStats::Add(const LpcTransaction& t) {
+  if ((t.flags & kCycleAborted) || t.sync == LpcTransaction::kNone) {
+    return;
+  }
+  const U8 bits = BucketBits(t.start_code, t.cyctype);
+  const U32 mask = bits >= 32 ? 0 : ~0u << bits;
+  const Key key{t.start_code, t.cyctype, t.has_address ? t.address & mask : 0};
+  if (last_ == nullptr || key < last_key_ || last_key_ < key) {
+    last_key_ = key;
+    last_ = &entries_[key];
+  }
+  last_->waits.Record(t.sync_waits);
+  last_->duration.Record(t.end - t.start);
+}
+
+U32 LpcLatencyStats::BucketLast(const Key& key) const {
+  const U8 bits = BucketBits(key.start_code, key.cyctype);
+  return key.bucket | (bits >= 32 ? ~0u : ~(~0u << bits));
+}
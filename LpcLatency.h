@@ -0,0 +1,110 @@
+#pragma once
+
+#include <bit>
+#include <map>
+#include <tuple>
+#include <vector>
+#include "LpcTransactions.h"
+
+// SYNC wait and cycle duration statistics, to find which device stalls the
+// bus. Kept per START, cycle type and address bucket as cycles are committed,
+// so percentiles are there without going over the capture again.
+
+// Log-linear ("HDR") histogram of U64 values. Values below 2^kSubBits are
+// counted exactly; above that, every power of two is split into 2^kSubBits
+// buckets, so any value is off by less than 1/2^kSubBits (~3%).
+class LpcHistogram {
+ public:
+  static constexpr U32 kSubBits = 5;
+  static constexpr U32 kSubBuckets = 1 << kSubBits;
+
+  void Record(U64 value) {
+    const U32 i = Index(value);
+    if (i >= counts_.size()) {
+      counts_.resize(i + 1);
+    }
+    counts_[i]++;
+    if (count_ == 0 || value < min_) {
+      min_ = value;
+    }
+    if (value > max_) {
+      max_ = value;
+    }
+    count_++;
+    sum_ += value;
+  }
+  void Merge(const LpcHistogram& other);
+
+  U64 count() const { return count_; }
+  U64 min() const { return min_; }
+  U64 max() const { return max_; }
+  double mean() const { return count_ ? (double)sum_ / count_ : 0; }
+  // Smallest value that at least |percent| % of the values are at or below,
+  // up to the bucket's precision. 0 if empty.
+  U64 Percentile(double percent) const;
+
+  static U32 Index(U64 value) {
+    if (value < kSubBuckets) {
+      return (U32)value;
+    }
+    const U32 msb = 63 - std::countl_zero(value);
+    const U32 shift = msb - kSubBits;
+    return ((shift + 1) << kSubBits) + (U32)(value >> shift) - kSubBuckets;
+  }
+  // largest value counted in bucket |index|
+  static U64 UpperBound(U32 index);
+
+ private:
+  // grown to the largest bucket used, most values are small
+  std::vector<U64> counts_;
+  U64 count_{};
+  U64 min_{};
+  U64 max_{};
+  U64 sum_{};
+};
+
+class LpcLatencyStats {
+ public:
+  struct Key {
+    U8 start_code;
+    // LpcTransaction::kNone for cycles without one (FW)
+    U8 cyctype;
+    // first address of the bucket, 0 for cycles without an address
+    U32 bucket;
+    bool operator<(const Key& other) const {
+      return std::tie(start_code, cyctype, bucket) <
+             std::tie(other.start_code, other.cyctype, other.bucket);
+    }
+  };
+  struct Entry {
+    // SYNC wait clocks (ShortWait/LongWait) before the final SYNC
+    LpcHistogram waits;
+    // START to the end of the cycle, in samples
+    LpcHistogram duration;
+  };
+
+  // Addresses are bucketed by dropping this many low bits. The defaults keep
+  // IO ports apart and put memory in 4 KB pages (a TPM locality, an EC
+  // window).
+  U8 io_bucket_bits{0};
+  U8 memory_bucket_bits{12};
+
+  void clear() {
+    entries_.clear();
+    last_ = nullptr;
+  }
+  // Completed cycles only, aborted ones would only skew the durations.
+  void Add(const LpcTransaction& t);
+  // last address of the bucket that starts at |key|.bucket
+  U32 BucketLast(const Key& key) const;
+
+  const std::map<Key, Entry>& entries() const { return entries_; }
+
+ private:
+  U8 BucketBits(U8 start_code, U8 cyctype) const;
+
+  std::map<Key, Entry> entries_;
+  // consecutive cycles often go to the same place
+  Key last_key_{};
+  Entry* last_{};
+};
@@ -0,0 +1,54 @@
+#include "LpcParallel.h"
+#include <algorithm>
+#include <utility>
+
+LpcParallelDecoder::LpcParallelDecoder(size_t num_threads,
+                                       const LpcCycleFilter* filter)
+    : pool_(num_threads), filter_(filter), decoders_(1) {
+  decoders_.front().filter_ = filter;
+}
+
+void LpcParallelDecoder::Decode(
+    const LpcClocks& clocks,
+    const std::function<void(LpcDecoder&)>& commit) {
+  // a few chunks per thread, so there is something left to steal
+  const size_t step =
+      std::max(clocks.size() / (pool_.size() * 4), kMinChunkClocks);
+  bounds_.assign(1, 0);
+  for (size_t i = clocks.NextCycleStart(step); i < clocks.size();
+       i = clocks.NextCycleStart(i + step)) {
+    bounds_.push_back(i);
+  }
+  bounds_.push_back(clocks.size());
+
+  const size_t num_chunks = bounds_.size() - 1;
+  decoders_.resize(num_chunks);
+  for (auto& decoder : decoders_) {
+    decoder.filter_ = filter_;
+  }
+  auto decode_chunk = [&](size_t i) {
+    auto& decoder = decoders_[i];
+    decoder.Decode(clocks, bounds_[i], bounds_[i + 1]);
+    if (i + 1 < num_chunks) {
+      // same as what the LFRAMEn assertion starting the next chunk does
+      decoder.Finish();
+    }
+  };
+  if (num_chunks == 1) {
+    decode_chunk(0);
+  } else {
+    pool_.ParallelFor(num_chunks, decode_chunk);
+  }
+
+  for (auto& decoder : decoders_) {
+    commit(decoder);
+  }
+  std::swap(decoders_.front(), decoders_.back());
+  decoders_.resize(1);
+}
+
+void LpcParallelDecoder::Finish(
+    const std::function<void(LpcDecoder&)>& commit) {
+  decoders_.front().Finish();
+  commit(decoders_.front());
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <functional>
+#include "LpcClocks.h"
+#include "LpcDecoder.h"
+#include "LpcThreadPool.h"
+
+// Decodes blocks of clocks on a thread pool. A block is cut into chunks where
+// LFRAMEn gets asserted, since the decoder state resets there anyway, and
+// every chunk is decoded by its own LpcDecoder. The first chunk continues the
+// cycle left over from the previous block, the last one carries its cycle in
+// progress over to the next block.
+class LpcParallelDecoder {
+ public:
+  // chunks smaller than this aren't worth handing to another thread
+  static constexpr size_t kMinChunkClocks = 1 << 15;
+
+  // |filter| is passed on to every chunk's decoder, it may be null
+  explicit LpcParallelDecoder(size_t num_threads,
+                              const LpcCycleFilter* filter = nullptr);
+
+  // Decodes |clocks|, which continue from the previous call, then passes each
+  // chunk's decoder to |commit| in sample order. |commit| takes the completed
+  // cycles and their frames out of the decoder.
+  void Decode(const LpcClocks& clocks,
+              const std::function<void(LpcDecoder&)>& commit);
+  // End of capture: closes the cycle in progress, if any.
+  void Finish(const std::function<void(LpcDecoder&)>& commit);
+  // no cycle carried over to the next block
+  bool Idle() const { return decoders_.front().Idle(); }
+
+ private:
+  LpcThreadPool pool_;
+  const LpcCycleFilter* filter_;
+  // decoders_[0] has the cycle carried over between blocks
+  std::vector<LpcDecoder> decoders_;
+  std::vector<size_t> bounds_;
+};
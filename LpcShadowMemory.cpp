@@ -0,0 +1,127 @@
+#include "LpcShadowMemory.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+
+LpcShadowSpace::LpcShadowSpace(U64 size)
+    : size_(size),
+      directory_(std::max<U64>(size >> (kPageBits + kTableBits), 1)) {}
+
+LpcShadowSpace::Page* LpcShadowSpace::AllocatePage(U32 number) {
+  auto& table = directory_[number >> kTableBits];
+  if (!table) {
+    table = std::make_unique<Table>();
+  }
+  auto& page = (*table)[number & ((1 << kTableBits) - 1)];
+  if (!page) {
+    page = std::make_unique<Page>();
+    num_pages_++;
+  }
+  return page.get();
+}
+
+const LpcShadowSpace::Page* LpcShadowSpace::FindPage(U32 number) const {
+  const auto& table = directory_[number >> kTableBits];
+  return table ? (*table)[number & ((1 << kTableBits) - 1)].get() : nullptr;
+}
+
+bool LpcShadowSpace::Read(U32 address, U8* value) const {
+  const Page* page = FindPage(address >> kPageBits);
+  const U32 offset = address & (kPageSize - 1);
+  if (page == nullptr || !(page->observed[offset / 64] >> (offset % 64) & 1)) {
+    return false;
+  }
+  *value = page->data[offset];
+  return true;
+}
+
+void LpcShadowSpace::CopyOut(U64 begin, size_t n, U8 fill, U8* out) const {
+  while (n > 0) {
+    const U32 offset = begin & (kPageSize - 1);
+    const size_t len = std::min<size_t>(n, kPageSize - offset);
+    const Page* page = FindPage((U32)(begin >> kPageBits));
+    if (page == nullptr) {
+      std::memset(out, fill, len);
+    } else {
+      for (size_t i = 0; i < len; i++) {
+        const U32 o = offset + (U32)i;
+        out[i] = page->observed[o / 64] >> (o % 64) & 1 ? page->data[o] : fill;
+      }
+    }
+    begin += len;
+    out += len;
+    n -= len;
+  }
+}
+
+bool LpcShadowSpace::FirstObserved(U64 begin, U64 end, U64* first) const {
+  for (U64 a = begin; a < end;) {
+    const Page* page = FindPage((U32)(a >> kPageBits));
+    if (page == nullptr) {
+      a = (a | (kPageSize - 1)) + 1;
+      continue;
+    }
+    const U32 offset = a & (kPageSize - 1);
+    const U64 bits = page->observed[offset / 64] >> (offset % 64);
+    if (bits != 0) {
+      *first = a + std::countr_zero(bits);
+      return *first < end;
+    }
+    a = (a | 63) + 1;
+  }
+  return false;
+}
+
+void LpcShadowMemory::Replay(const LpcTransaction& t, const U8* data) {
+  if ((t.flags & kCycleAborted) || t.sync != kReady) {
+    return;
+  }
+  LpcShadowSpace* space = nullptr;
+  U32 base = 0;
+  if (t.start_code == kFwRead || t.start_code == kFwWrite) {
+    space = &memory;
+    base = kFwBase;
+  } else if (t.start_code == kStart &&
+             (t.cyctype == kIoRead || t.cyctype == kIoWrite)) {
+    space = &io;
+  } else if (t.start_code == kStart &&
+             (t.cyctype == kMemRead || t.cyctype == kMemWrite)) {
+    space = &memory;
+  }
+  if (space == nullptr) {
+    return;
+  }
+  // multi-byte FW transfers are to consecutive addresses
+  U32 address = (base | t.address) & (U32)(space->size() - 1);
+  for (U8 i = 0; i < t.data_bytes; i++) {
+    space->Write(address++, data[i]);
+  }
+  replayed_cycles++;
+}
+
+void LpcShadowMemory::Replay(const LpcCycle& cycle, const LpcFrame* frames) {
+  if (cycle.flags & kCycleAborted) {
+    return;
+  }
+  const LpcTransaction t = SummarizeCycle(cycle, frames, 0);
+  std::array<U8, 0xff> data;
+  U8 n = 0;
+  for (U32 i = 0; i < cycle.num_frames && n < t.data_bytes; i++) {
+    if (frames[i].type == kDATA) {
+      data[n++] = (U8)frames[i].data1;
+    }
+  }
+  Replay(t, data.data());
+}
+
+void LpcShadowMemory::RomImageRange(U64* begin, U64* size) const {
+  const U64 top = memory.size();
+  U64 first = 0;
+  *size = kMinRomSize;
+  if (memory.FirstObserved(top - kRomWindow, top, &first)) {
+    *size = std::max(kMinRomSize, std::bit_ceil(top - first));
+  }
+  *begin = top - *size;
+}
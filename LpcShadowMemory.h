@@ -0,0 +1,90 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+#include "LpcTransactions.h"
+
+// Sparse copy of one address space: which bytes were seen on the bus, and the
+// last value of each. Pages are allocated on first touch, through a two level
+// table, so a boot trace costs a few MB however the addresses are spread.
+class LpcShadowSpace {
+ public:
+  static constexpr U32 kPageBits = 12;
+  static constexpr U32 kPageSize = 1 << kPageBits;
+
+  // |size| is a power of two, at most 4 GB
+  explicit LpcShadowSpace(U64 size);
+
+  void Write(U32 address, U8 value) {
+    Page* page = GetPage(address >> kPageBits);
+    const U32 offset = address & (kPageSize - 1);
+    U64& observed = page->observed[offset / 64];
+    const U64 bit = (U64)1 << (offset % 64);
+    num_observed_ += (observed & bit) == 0;
+    observed |= bit;
+    page->data[offset] = value;
+  }
+  // false if the byte was never seen
+  bool Read(U32 address, U8* value) const;
+  // [begin, begin + n), |fill| for bytes never seen
+  void CopyOut(U64 begin, size_t n, U8 fill, U8* out) const;
+  // lowest observed address in [begin, end), false if there isn't one
+  bool FirstObserved(U64 begin, U64 end, U64* first) const;
+
+  U64 size() const { return size_; }
+  size_t num_pages() const { return num_pages_; }
+  U64 num_observed() const { return num_observed_; }
+
+ private:
+  static constexpr U32 kTableBits = 10;
+  struct Page {
+    std::array<U8, kPageSize> data;
+    std::array<U64, kPageSize / 64> observed;
+  };
+  using Table = std::array<std::unique_ptr<Page>, 1 << kTableBits>;
+
+  Page* GetPage(U32 number) {
+    if (number != cached_number_) {
+      cached_ = AllocatePage(number);
+      cached_number_ = number;
+    }
+    return cached_;
+  }
+  Page* AllocatePage(U32 number);
+  const Page* FindPage(U32 number) const;
+
+  U64 size_;
+  std::vector<std::unique_ptr<Table>> directory_;
+  size_t num_pages_{};
+  U64 num_observed_{};
+  // consecutive accesses mostly hit the same page
+  U32 cached_number_{~0u};
+  Page* cached_{};
+};
+
+// The target's memory and IO spaces, rebuilt by replaying decoded cycles.
+// Reads and writes both count: either way the byte had that value. Cycles
+// that were aborted or didn't end with a Ready SYNC are skipped.
+class LpcShadowMemory {
+ public:
+  // FW addresses are 28 bits, firmware hubs decode the top of memory
+  static constexpr U32 kFwBase = 0xf0000000;
+  // where a flash/ROM image is looked for
+  static constexpr U64 kRomWindow = 16 << 20;
+  static constexpr U64 kMinRomSize = 64 << 10;
+
+  LpcShadowMemory() : memory(1ull << 32), io(1 << 16) {}
+
+  // |data| is all t.data_bytes of the cycle's DATA bytes
+  void Replay(const LpcTransaction& t, const U8* data);
+  void Replay(const LpcCycle& cycle, const LpcFrame* frames);
+
+  // Smallest power of two sized image, at least kMinRomSize, that ends at
+  // 4 GB and holds every byte seen in the top kRomWindow of memory.
+  void RomImageRange(U64* begin, U64* size) const;
+
+  LpcShadowSpace memory;
+  LpcShadowSpace io;
+  U64 replayed_cycles{};
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include "LpcDecoder.h"
+
+// Where decode time goes: channel access, the state machine, committing
+// frames or formatting. Counters and timers are only compiled in with
+// LPC_STATS=1 (cmake -DLPC_STATS=ON); otherwise they cost nothing and read 0.
+
+enum LpcCounter : U8 {
+  // LCLK clocks decoded
+  kCountClocks,
+  // AdvanceToNextEdge() calls on LCLK
+  kCountClockEdges,
+  // AdvanceToAbsPosition() calls, to sample LAD/LFRAMEn at each clock and to
+  // seek
+  kCountAdvanceToAbsPosition,
+  // GetSampleOfNextEdge() calls, to look ahead without seeking
+  kCountNextEdgeQueries,
+  // AddFrame() calls, and those dropped for start >= end
+  kCountFrames,
+  kCountRejectedFrames,
+  kCountCycles,
+  kCountAbortedCycles,
+  // LCLK/LFRAMEn pulses ignored for being too short
+  kCountGlitches,
+  kNumCounters,
+};
+
+enum LpcTimer : U8 {
+  // getting the clocks out of the channel data
+  kTimeExtract,
+  // running the state machine over them
+  kTimeDecode,
+  // TPM reassembly, dissectors and AddFrame, CommitResults included
+  kTimeCommit,
+  kTimeCommitResults,
+  kTimeExport,
+  kNumTimers,
+};
+
+struct LpcStats {
+  std::array<U64, kNumCounters> counts{};
+  std::array<U64, kNumTimers> ns{};
+  std::array<U64, kNumTimers> calls{};
+
+  void Count(LpcCounter counter, U64 n = 1) {
+    if constexpr (LPC_STATS) {
+      counts[counter] += n;
+    }
+  }
+  // Adds a decoder's counts and clears them.
+  void Take(LpcDecoderCounts* decoder) {
+    if constexpr (LPC_STATS) {
+      counts[kCountClocks] += decoder->clocks;
+      counts[kCountFrames] += decoder->frames;
+      counts[kCountRejectedFrames] += decoder->rejected_frames;
+      counts[kCountCycles] += decoder->cycles;
+      counts[kCountAbortedCycles] += decoder->aborted_cycles;
+      *decoder = {};
+    }
+  }
+  void Merge(const LpcStats& other) {
+    for (size_t i = 0; i < counts.size(); i++) {
+      counts[i] += other.counts[i];
+    }
+    for (size_t i = 0; i < ns.size(); i++) {
+      ns[i] += other.ns[i];
+      calls[i] += other.calls[i];
+    }
+  }
+};
+
+inline const char* CounterName(LpcCounter counter) {
+  static constexpr const char* kNames[] = {
+      "clocks",            "lclk_edges",     "advance_to_abs_position",
+      "next_edge_queries", "frames",         "rejected_frames",
+      "cycles",            "aborted_cycles", "glitches",
+  };
+  return kNames[counter];
+}
+inline const char* TimerName(LpcTimer timer) {
+  static constexpr const char* kNames[] = {
+      "extract", "decode", "commit", "commit_results", "export",
+  };
+  return kNames[timer];
+}
+
+// Adds the time until it goes out of scope to |timer|.
+class LpcStatsTimer {
+ public:
+  LpcStatsTimer(LpcStats* stats, LpcTimer timer)
+      : stats_(stats), timer_(timer) {
+    if constexpr (LPC_STATS) {
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  ~LpcStatsTimer() {
+    if constexpr (LPC_STATS) {
+      const auto elapsed = std::chrono::steady_clock::now() - start_;
+      stats_->ns[timer_] +=
+          std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed)
+              .count();
+      stats_->calls[timer_]++;
+    }
+  }
+  LpcStatsTimer(const LpcStatsTimer&) = delete;
+  LpcStatsTimer& operator=(const LpcStatsTimer&) = delete;
+
+ private:
+  LpcStats* stats_;
+  LpcTimer timer_;
+  std::chrono::steady_clock::time_point start_;
+};
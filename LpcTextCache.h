@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "LpcDecoder.h"
+
+// Text rendered for frames, so scrolling back and forth over the same ones
+// doesn't format them again. Direct mapped on the frame index; |kind| tells
+// apart the texts of one frame (bubble or table, and the display base).
+class LpcTextCache {
+ public:
+  static constexpr size_t kSize = 4096;
+
+  LpcTextCache() : entries_(kSize) {}
+
+  // null if not cached
+  const std::vector<std::string>* Find(U64 frame_index, U32 kind) const {
+    const Entry& e = entries_[frame_index % kSize];
+    if (e.frame_index != frame_index || e.kind != kind) {
+      return nullptr;
+    }
+    return &e.strings;
+  }
+  void Insert(U64 frame_index, U32 kind, std::vector<std::string> strings) {
+    Entry& e = entries_[frame_index % kSize];
+    e.frame_index = frame_index;
+    e.kind = kind;
+    e.strings = std::move(strings);
+  }
+  // when the frames change, on a rerun
+  void Clear() {
+    for (auto& e : entries_) {
+      e.frame_index = kEmpty;
+      e.strings.clear();
+    }
+  }
+
+ private:
+  static constexpr U64 kEmpty = ~0ull;
+  struct Entry {
+    U64 frame_index{kEmpty};
+    U32 kind{};
+    std::vector<std::string> strings;
+  };
+  std::vector<Entry> entries_;
+};
@@ -0,0 +1,91 @@
+#include "LpcThreadPool.h"
+
+LpcThreadPool::LpcThreadPool(size_t num_threads) {
+  if (num_threads == 0) {
+    num_threads = 1;
+  }
+  for (size_t i = 0; i < num_threads; i++) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+  for (size_t i = 0; i < num_threads; i++) {
+    threads_.emplace_back([this, i] { WorkerLoop(i); });
+  }
+}
+
+LpcThreadPool::~LpcThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  for (auto& t : threads_) {
+    t.join();
+  }
+}
+
+void LpcThreadPool::ParallelFor(size_t n,
+                                const std::function<void(size_t)>& fn) {
+  if (n == 0) {
+    return;
+  }
+  // a worker still draining the previous round may pick these up right away
+  remaining_ = n;
+  for (size_t i = 0; i < n; i++) {
+    auto& q = *queues_[i % queues_.size()];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    q.tasks.push_back({&fn, i});
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    generation_++;
+  }
+  work_cv_.notify_all();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_cv_.wait(lock, [this] { return remaining_ == 0; });
+}
+
+bool LpcThreadPool::PopTask(size_t id, Task* task) {
+  {
+    auto& q = *queues_[id];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (!q.tasks.empty()) {
+      *task = q.tasks.front();
+      q.tasks.pop_front();
+      return true;
+    }
+  }
+  for (size_t i = 1; i < queues_.size(); i++) {
+    auto& q = *queues_[(id + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (!q.tasks.empty()) {
+      *task = q.tasks.back();
+      q.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void LpcThreadPool::WorkerLoop(size_t id) {
+  size_t seen_generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      work_cv_.wait(lock,
+                    [&] { return stop_ || generation_ != seen_generation; });
+      if (stop_) {
+        return;
+      }
+      seen_generation = generation_;
+    }
+    Task task;
+    while (PopTask(id, &task)) {
+      (*task.fn)(task.index);
+      if (--remaining_ == 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_cv_.notify_all();
+      }
+    }
+  }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small work-stealing pool. Tasks are dealt round-robin onto per-worker
+// queues; a worker takes from the front of its own queue and, once that is
+// empty, steals from the back of the others. Chunks of a capture vary a lot in
+// how long they take to decode (idle vs. busy bus), so this keeps all cores
+// busy without needing to size chunks well.
+class LpcThreadPool {
+ public:
+  explicit LpcThreadPool(size_t num_threads);
+  ~LpcThreadPool();
+  LpcThreadPool(const LpcThreadPool&) = delete;
+  LpcThreadPool& operator=(const LpcThreadPool&) = delete;
+
+  size_t size() const { return threads_.size(); }
+
+  // Runs fn(i) for every i in [0, n) on the pool, returns once all are done.
+  // Not reentrant.
+  void ParallelFor(size_t n, const std::function<void(size_t)>& fn);
+
+ private:
+  struct Task {
+    const std::function<void(size_t)>* fn;
+    size_t index;
+  };
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void WorkerLoop(size_t id);
+  bool PopTask(size_t id, Task* task);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  std::atomic<size_t> remaining_{};
+  size_t generation_{};
+  bool stop_{};
+};
@@ -0,0 +1,243 @@
+#include "LpcTpm.h"
+#include <algorithm>
+
+// TIS register offsets within a locality
+static constexpr U32 kTpmAccess = 0x000;
+static constexpr U32 kTpmSts = 0x018;
+static constexpr U32 kTpmDataFifo = 0x024;
+static constexpr U32 kTpmXDataFifo = 0x080;
+
+static constexpr U8 kAccessActiveLocality = 0x20;
+static constexpr U8 kStsCommandReady = 0x40;
+static constexpr U8 kStsGo = 0x20;
+
+// tag, size, command/response code
+static constexpr U32 kHeaderSize = 10;
+
+const char* TpmCommandName(U32 code) {
+  static constexpr struct {
+    U32 code;
+    const char* name;
+  } kNames[] = {
+      {0x11f, "NV_UndefineSpaceSpecial"},
+      {0x121, "EvictControl"},
+      {0x127, "Clear"},
+      {0x12a, "NV_DefineSpace"},
+      {0x131, "CreatePrimary"},
+      {0x137, "NV_Write"},
+      {0x13c, "NV_WriteLock"},
+      {0x143, "SelfTest"},
+      {0x144, "Startup"},
+      {0x145, "Shutdown"},
+      {0x14e, "NV_Read"},
+      {0x153, "Create"},
+      {0x157, "Load"},
+      {0x15d, "Unseal"},
+      {0x161, "ContextLoad"},
+      {0x162, "ContextSave"},
+      {0x165, "FlushContext"},
+      {0x169, "NV_ReadPublic"},
+      {0x173, "ReadPublic"},
+      {0x176, "StartAuthSession"},
+      {0x17a, "GetCapability"},
+      {0x17b, "GetRandom"},
+      {0x17e, "PCR_Read"},
+      {0x17f, "PolicyPCR"},
+      {0x182, "PCR_Extend"},
+      {0x185, "EventSequenceComplete"},
+      {0x186, "HashSequenceStart"},
+      {0x18f, "PolicyGetDigest"},
+  };
+  auto it = std::lower_bound(
+      std::begin(kNames), std::end(kNames), code,
+      [](const auto& entry, U32 code) { return entry.code < code; });
+  return it != std::end(kNames) && it->code == code ? it->name : nullptr;
+}
+
+static U32 BigEndian(const U8* p, size_t n) {
+  U32 value = 0;
+  for (size_t i = 0; i < n; i++) {
+    value = value << 8 | p[i];
+  }
+  return value;
+}
+
+LpcTpmReassembler::LpcTpmReassembler()
+    : arena_(2 * kLocalities * kMaxMessage) {
+  for (size_t i = 0; i < localities_.size(); i++) {
+    localities_[i].command.data = &arena_[2 * i * kMaxMessage];
+    localities_[i].response.data = &arena_[(2 * i + 1) * kMaxMessage];
+  }
+}
+
+void LpcTpmReassembler::Reset() {
+  for (auto& l : localities_) {
+    l.command.size = 0;
+    l.response.size = 0;
+  }
+}
+
+void LpcTpmReassembler::Append(Buffer& buffer, U64 start, U8 value) {
+  if (buffer.size == 0) {
+    buffer.start = start;
+  }
+  if (buffer.size < kMaxMessage) {
+    buffer.data[buffer.size++] = value;
+  }
+}
+
+bool LpcTpmReassembler::Complete(Buffer& buffer,
+                                 U8 locality,
+                                 bool response,
+                                 U64 end,
+                                 bool force,
+                                 LpcTpmMessage* message) {
+  const bool has_header = buffer.size >= kHeaderSize;
+  const U32 header_size = has_header ? BigEndian(buffer.data + 2, 4) : 0;
+  const bool done =
+      has_header && buffer.size == std::min(header_size, kMaxMessage);
+  if (!done && !(force && buffer.size > 0)) {
+    return false;
+  }
+  *message = {buffer.start,
+              end,
+              buffer.data,
+              buffer.size,
+              header_size,
+              has_header ? (U16)BigEndian(buffer.data, 2) : (U16)0,
+              has_header ? BigEndian(buffer.data + 6, 4) : 0,
+              locality,
+              response};
+  buffer.size = 0;
+  return true;
+}
+
+bool LpcTpmReassembler::Add(const LpcCycle& cycle,
+                            const LpcFrame* frames,
+                            LpcTpmMessage* message) {
+  if ((cycle.flags & kCycleAborted) ||
+      (cycle.start_code != kTpmStart && cycle.start_code != kStart)) {
+    return false;
+  }
+  U8 cyctype = 0xff;
+  U32 address = 0;
+  bool has_address = false;
+  bool has_data = false;
+  U8 value = 0;
+  bool ready = false;
+  for (U32 i = 0; i < cycle.num_frames; i++) {
+    const LpcFrame& f = frames[i];
+    switch (f.type) {
+    case kCYCTYPE_DIR:
+      cyctype = (U8)f.data1;
+      break;
+    case kADDR:
+      address = (U32)f.data1;
+      has_address = true;
+      break;
+    case kDATA:
+      value = (U8)f.data1;
+      has_data = true;
+      break;
+    case kSYNC:
+      ready = f.data1 == kReady;
+      break;
+    default:
+      break;
+    }
+  }
+  if (!has_address || !has_data || !ready) {
+    return false;
+  }
+  bool write;
+  if (cyctype == kIoWrite || cyctype == kMemWrite) {
+    write = true;
+  } else if (cyctype == kIoRead || cyctype == kMemRead) {
+    write = false;
+  } else {
+    return false;
+  }
+  // plain LPC cycles only count inside the TPM window
+  if (cycle.start_code == kStart &&
+      (cyctype != (write ? kMemWrite : kMemRead) ||
+       (address & 0xffff0000) != kWindow)) {
+    return false;
+  }
+  const U8 locality = address >> 12 & 0xf;
+  const U32 reg = address & 0xfff;
+  if (locality >= kLocalities) {
+    return false;
+  }
+  Locality& l = localities_[locality];
+
+  if (reg == kTpmAccess) {
+    if (write && (value & kAccessActiveLocality)) {
+      // relinquished, whatever was in progress is gone
+      l.command.size = 0;
+      l.response.size = 0;
+    }
+    return false;
+  }
+  if (reg == kTpmSts) {
+    if (!write) {
+      return false;
+    }
+    if (value & kStsCommandReady) {
+      l.command.size = 0;
+      l.response.size = 0;
+      return false;
+    }
+    // a command shorter than its header says still goes
+    return (value & kStsGo) &&
+           Complete(l.command, locality, false, cycle.end, true, message);
+  }
+  if ((reg & ~3u) != kTpmDataFifo && (reg & ~3u) != kTpmXDataFifo) {
+    return false;
+  }
+  if (write) {
+    if (l.command.size == 0) {
+      l.response.size = 0;
+    }
+    Append(l.command, cycle.start, value);
+    return Complete(l.command, locality, false, cycle.end, false, message);
+  }
+  Append(l.response, cycle.start, value);
+  return Complete(l.response, locality, true, cycle.end, false, message);
+}
+
+void LpcTpmReassembler::Process(LpcDecoder& decoder) {
+  auto& frames = decoder.frames_;
+  size_t pos = 0;
+  bool copying = false;
+  for (auto& cycle : decoder.cycles_) {
+    const size_t n = cycle.num_frames;
+    const LpcFrame* f = frames.data() + pos;
+    LpcTpmMessage message;
+    // The message frame takes the second half of the cycle's final TAR, so
+    // it doesn't overlap anything.
+    const bool add = Add(cycle, f, &message) && n > 0 &&
+                     f[n - 1].type == kTURN_AROUND &&
+                     f[n - 1].end - f[n - 1].start >= 3;
+    if (add && !copying) {
+      scratch_.assign(frames.begin(), frames.begin() + pos);
+      copying = true;
+    }
+    if (copying) {
+      scratch_.insert(scratch_.end(), f, f + n);
+    }
+    pos += n;
+    if (add) {
+      LpcFrame& tar = scratch_.back();
+      const U64 end = tar.end;
+      tar.end = tar.start + (end - tar.start) / 2;
+      scratch_.push_back({tar.end + 1, end, TpmFrameData1(message),
+                          TpmFrameData2(message), kTPM_MESSAGE, 0});
+      cycle.num_frames++;
+    }
+  }
+  if (copying) {
+    // and the frames of the cycle in progress
+    scratch_.insert(scratch_.end(), frames.begin() + pos, frames.end());
+    frames.swap(scratch_);
+  }
+}
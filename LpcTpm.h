@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include "LpcDecoder.h"
+
+// TPM commands and responses, put back together from the single byte
+// accesses to the FIFO interface (TPM_ACCESS, TPM_STS, TPM_DATA_FIFO and
+// TPM_XDATA_FIFO) of each locality. Both TPM cycles (START 0101) and memory
+// cycles to the TPM window at 0xfed40000 are followed.
+//
+// A command is complete when as many bytes as its header says have been
+// written, or on tpmGo. A response is complete when as many bytes as its
+// header says have been read. commandReady starts over.
+
+struct LpcTpmMessage {
+  // START of the first cycle, and the end of the last
+  U64 start;
+  U64 end;
+  // valid until the next cycle is added
+  const U8* data;
+  U32 size;
+  // from the header, 0 if it's too short to have one. If size is smaller than
+  // header_size, the message was cut short (or didn't fit).
+  U32 header_size;
+  U16 tag;
+  // command code (TPM 2.0) / ordinal (TPM 1.2), or the response code
+  U32 code;
+  U8 locality;
+  bool response;
+};
+
+// Packing of the kTPM_MESSAGE frames
+//   data1: code | tag << 32
+//   data2: size | locality << 32 | response << 40
+inline U64 TpmFrameData1(const LpcTpmMessage& m) {
+  return m.code | (U64)m.tag << 32;
+}
+inline U64 TpmFrameData2(const LpcTpmMessage& m) {
+  return m.size | (U64)m.locality << 32 | (U64)m.response << 40;
+}
+
+// TPM 2.0 command name, without the TPM2_ prefix; nullptr if not known.
+const char* TpmCommandName(U32 code);
+
+class LpcTpmReassembler {
+ public:
+  static constexpr U32 kMaxMessage = 4096;
+  static constexpr U8 kLocalities = 5;
+  static constexpr U32 kWindow = 0xfed40000;
+
+  LpcTpmReassembler();
+
+  void Reset();
+  // |frames| are the cycle's frames. Returns true if the cycle completed a
+  // command or response, which is then in |message|.
+  bool Add(const LpcCycle& cycle,
+           const LpcFrame* frames,
+           LpcTpmMessage* message);
+  // Adds a kTPM_MESSAGE frame after the frames of each cycle in |decoder|
+  // that completes a message. Cycles must be passed in order, so with the
+  // parallel decoder this is done at commit time.
+  void Process(LpcDecoder& decoder);
+
+ private:
+  struct Buffer {
+    U8* data;
+    U32 size;
+    U64 start;
+  };
+  struct Locality {
+    Buffer command;
+    Buffer response;
+  };
+  void Append(Buffer& buffer, U64 start, U8 value);
+  bool Complete(Buffer& buffer,
+                U8 locality,
+                bool response,
+                U64 end,
+                bool force,
+                LpcTpmMessage* message);
+
+  // every locality's command and response buffer, allocated once
+  std::vector<U8> arena_;
+  std::array<Locality, kLocalities> localities_;
+  std::vector<LpcFrame> scratch_;
+};
@@ -0,0 +1,204 @@
+#include "LpcTraffic.h"
+#include <iterator>
+
+// IO ports seen on a typical board: POST codes, KBC, SuperIO config, EC, RTC
+// and COM1.
+static constexpr U16 kIoPorts[] = {
+    0x80, 0x60, 0x64, 0x2e, 0x2f, 0x4e, 0x4f, 0x62, 0x66, 0x70, 0x71, 0x3f8,
+};
+static constexpr U8 kFwMsizes[] = {0, 1, 2, 4};
+static constexpr U8 kDmaChannels[] = {0, 1, 2, 3, 5, 6, 7};
+// SIZE field: 8, 16 and 32 bit
+static constexpr U8 kDmaSizes[] = {0b00, 0b01, 0b11};
+
+// TPM locality 0 registers, offsets into 0xfed40000
+static constexpr U16 kTpmSts = 0x0018;
+static constexpr U16 kTpmDataFifo = 0x0024;
+
+LpcTrafficGenerator::LpcTrafficGenerator(const LpcTrafficMix& mix)
+    : mix_(mix), state_(mix.seed != 0 ? mix.seed : 1) {
+  const U32 weights[] = {mix.io, mix.mem, mix.fw, mix.dma, mix.tpm};
+  U32 sum = 0;
+  for (size_t i = 0; i < cumulative_.size(); i++) {
+    sum += weights[i];
+    cumulative_[i] = sum;
+  }
+}
+
+void LpcTrafficGenerator::Nibbles(U64 value, size_t n, NibbleEndian endian) {
+  for (size_t i = 0; i < n; i++) {
+    const size_t shift = endian == kLSNFirst ? i * 4 : (n - 1 - i) * 4;
+    cycle_.push_back(((value >> shift) & kLADMask) | kLFRAMEnBit);
+  }
+}
+
+void LpcTrafficGenerator::Sync(U8 done) {
+  const U32 waits = Uniform(mix_.max_sync_waits + 1);
+  cycle_.insert(cycle_.end(), waits, sync_wait_ | kLFRAMEnBit);
+  cycle_.push_back(done | kLFRAMEnBit);
+}
+
+void LpcTrafficGenerator::IoCycle(U8 start, bool write, U16 addr, U8 data) {
+  Start(start);
+  Nibbles((write ? kIoWrite : kIoRead) << 1, 1, kLSNFirst);
+  Nibbles(addr, 4, kMSNFirst);
+  if (write) {
+    Nibbles(data, 2, kLSNFirst);
+    TurnAround();
+    Sync(kReady);
+  } else {
+    TurnAround();
+    Sync(kReady);
+    Nibbles(data, 2, kLSNFirst);
+  }
+  TurnAround();
+}
+
+void LpcTrafficGenerator::MemCycle(bool write, U32 addr, U8 data) {
+  Start(kStart);
+  Nibbles((write ? kMemWrite : kMemRead) << 1, 1, kLSNFirst);
+  Nibbles(addr, 8, kMSNFirst);
+  if (write) {
+    Nibbles(data, 2, kLSNFirst);
+    TurnAround();
+    Sync(kReady);
+  } else {
+    TurnAround();
+    Sync(kReady);
+    Nibbles(data, 2, kLSNFirst);
+  }
+  TurnAround();
+}
+
+void LpcTrafficGenerator::FwCycle(bool write, U32 addr, U8 msize) {
+  Start(write ? kFwWrite : kFwRead);
+  // IDSEL
+  Nibbles(0, 1, kLSNFirst);
+  Nibbles(addr, 7, kMSNFirst);
+  Nibbles(msize, 1, kLSNFirst);
+  const size_t bytes = (size_t)1 << msize;
+  if (write) {
+    for (size_t i = 0; i < bytes; i++) {
+      Nibbles(Random(), 2, kLSNFirst);
+    }
+    TurnAround();
+    Sync(kReady);
+  } else {
+    TurnAround();
+    Sync(kReady);
+    for (size_t i = 0; i < bytes; i++) {
+      Nibbles(Random(), 2, kLSNFirst);
+    }
+  }
+  TurnAround();
+}
+
+void LpcTrafficGenerator::DmaCycle(bool write, U8 channel, U8 size) {
+  Start(kStart);
+  Nibbles((write ? kDmaWrite : kDmaRead) << 1, 1, kLSNFirst);
+  Nibbles(channel, 1, kLSNFirst);
+  Nibbles(size, 1, kLSNFirst);
+  const size_t bytes = size == 0b11 ? 4 : size + 1;
+  // the peripheral may ask for more transfers on the last byte
+  const U8 last_sync = Chance(256) ? kReadyMore : kReady;
+  if (write) {
+    // peripheral to host: SYNC before each byte
+    TurnAround();
+    for (size_t i = 0; i < bytes; i++) {
+      Sync(i + 1 < bytes ? (U8)kReady : last_sync);
+      Nibbles(Random(), 2, kLSNFirst);
+    }
+  } else {
+    // host to peripheral: each byte is handed over and SYNCed on its own
+    for (size_t i = 0; i < bytes; i++) {
+      Nibbles(Random(), 2, kLSNFirst);
+      TurnAround();
+      Sync(i + 1 < bytes ? (U8)kReady : last_sync);
+      if (i + 1 < bytes) {
+        TurnAround();
+      }
+    }
+  }
+  TurnAround();
+}
+
+// TPM2_GetRandom through the FIFO interface: commandReady, command bytes,
+// tpmGo, poll for dataAvail, read the response, commandReady again.
+void LpcTrafficGenerator::TpmCommand(std::vector<U8>* bits) {
+  auto cycle = [&](bool write, U16 addr, U8 data) {
+    IoCycle(kTpmStart, write, addr, data);
+    Finish(bits, false);
+  };
+  const U8 n = 1 + Uniform(16);
+  const U8 command[] = {0x80, 0x01, 0, 0, 0, 12, 0, 0, 0x01, 0x7b, 0, n};
+
+  cycle(true, kTpmSts, 0x40);
+  for (U8 b : command) {
+    cycle(true, kTpmDataFifo, b);
+  }
+  cycle(true, kTpmSts, 0x20);
+  for (U32 polls = Uniform(4); polls > 0; polls--) {
+    cycle(false, kTpmSts, 0x80);
+  }
+  cycle(false, kTpmSts, 0x90);
+  const U8 header[] = {0x80, 0x01, 0, 0, 0, (U8)(12 + n), 0, 0, 0, 0, 0, n};
+  for (U8 b : header) {
+    cycle(false, kTpmDataFifo, b);
+  }
+  for (U8 i = 0; i < n; i++) {
+    cycle(false, kTpmDataFifo, (U8)Random());
+  }
+  cycle(true, kTpmSts, 0x40);
+}
+
+void LpcTrafficGenerator::Finish(std::vector<U8>* bits, bool may_abort) {
+  num_cycles_++;
+  if (may_abort && Chance(mix_.abort_per_1024)) {
+    // past START and CYCTYPE, LFRAMEn low for 4 clocks with LAD idle
+    cycle_.resize(2 + Uniform(cycle_.size() - 2));
+    cycle_.insert(cycle_.end(), 4, kLADMask);
+  }
+  if (may_abort && Chance(mix_.stop_per_1024)) {
+    Idle(1);
+    Start(kStop);
+    num_cycles_++;
+  }
+  Idle(mix_.min_idle + Uniform(mix_.max_idle - mix_.min_idle + 1));
+  bits->insert(bits->end(), cycle_.begin(), cycle_.end());
+  cycle_.clear();
+}
+
+void LpcTrafficGenerator::Next(std::vector<U8>* bits) {
+  if (cumulative_.back() == 0) {
+    bits->insert(bits->end(), mix_.max_idle + 1, kIdleBits);
+    return;
+  }
+  const U32 pick = Uniform(cumulative_.back());
+  sync_wait_ = Chance(512) ? kShortWait : kLongWait;
+  const bool write = Chance(512);
+  if (pick < cumulative_[0]) {
+    U16 port = kIoPorts[Uniform(std::size(kIoPorts))];
+    if (Chance(128)) {
+      port = (U16)Random();
+    }
+    IoCycle(kStart, write, port, (U8)Random());
+  } else if (pick < cumulative_[1]) {
+    // mostly BIOS flash
+    U32 addr = 0xfff00000 | Uniform(1 << 20);
+    if (Chance(256)) {
+      addr = (U32)Random();
+    }
+    MemCycle(write, addr, (U8)Random());
+  } else if (pick < cumulative_[2]) {
+    FwCycle(write, 0xff00000 | Uniform(1 << 20),
+            kFwMsizes[Uniform(std::size(kFwMsizes))]);
+  } else if (pick < cumulative_[3]) {
+    const U8 tc = Chance(256) ? 0b1000 : 0;
+    DmaCycle(write, kDmaChannels[Uniform(std::size(kDmaChannels))] | tc,
+             kDmaSizes[Uniform(std::size(kDmaSizes))]);
+  } else {
+    TpmCommand(bits);
+    return;
+  }
+  Finish(bits, true);
+}
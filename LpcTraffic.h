@@ -0,0 +1,164 @@
+#pragma once
+
+#include <array>
+#include <limits>
+#include <vector>
+#include "LpcClocks.h"
+#include "LpcDecoder.h"
+
+// Synthetic LPC traffic, for simulation data and benchmarks. Like the decoder
+// it doesn't depend on the SDK: LpcTrafficGenerator produces clocks (in
+// LpcClocks::bits format) and LpcSimulationWriter turns them into channel
+// transitions.
+
+// LCLK is 33.33 MHz. The writer wants at least 2 samples per half period.
+static constexpr U64 kLclkHzNum = 100000000;
+static constexpr U64 kLclkHzDen = 3;
+static constexpr U32 kLpcSimulationMinSampleRate = 133333334;
+
+struct LpcTrafficMix {
+  // relative weight of each kind of cycle
+  U32 io{8};
+  U32 mem{4};
+  U32 fw{2};
+  U32 dma{1};
+  // a TPM command: FIFO writes, status polling and the response reads
+  U32 tpm{1};
+  // chance per 1024 cycles of aborting one partway through, and of a Stop
+  // cycle following one
+  U32 abort_per_1024{8};
+  U32 stop_per_1024{8};
+  // number of SYNC wait states is uniform in [0, max_sync_waits]
+  U32 max_sync_waits{4};
+  // idle clocks after each cycle, uniform in [min_idle, max_idle]
+  U32 min_idle{1};
+  U32 max_idle{8};
+  U64 seed{0x4c50433031};
+};
+
+class LpcTrafficGenerator {
+ public:
+  explicit LpcTrafficGenerator(const LpcTrafficMix& mix);
+
+  // Appends the clocks of the next cycle (a whole command for TPM) and the idle
+  // clocks following it, one LAD[3:0] | LFRAMEn << 4 per clock.
+  void Next(std::vector<U8>* bits);
+
+  U64 num_cycles() const { return num_cycles_; }
+
+ private:
+  // xorshift64*, the same sequence everywhere unlike std distributions
+  U64 Random() {
+    state_ ^= state_ >> 12;
+    state_ ^= state_ << 25;
+    state_ ^= state_ >> 27;
+    return state_ * 0x2545f4914f6cdd1dULL;
+  }
+  // [0, n)
+  U32 Uniform(U32 n) { return (U32)(((Random() >> 32) * n) >> 32); }
+  bool Chance(U32 per_1024) { return Uniform(1024) < per_1024; }
+
+  void Idle(size_t n) { cycle_.insert(cycle_.end(), n, kIdleBits); }
+  void Start(U8 code) { cycle_.push_back(code & kLADMask); }
+  void Nibbles(U64 value, size_t n, NibbleEndian endian);
+  void TurnAround() { Idle(2); }
+  void Sync(U8 done);
+
+  void IoCycle(U8 start, bool write, U16 addr, U8 data);
+  void MemCycle(bool write, U32 addr, U8 data);
+  void FwCycle(bool write, U32 addr, U8 msize);
+  void DmaCycle(bool write, U8 channel, U8 size);
+  void TpmCommand(std::vector<U8>* bits);
+  void Finish(std::vector<U8>* bits, bool may_abort);
+
+  static constexpr U8 kIdleBits = kLADMask | kLFRAMEnBit;
+
+  LpcTrafficMix mix_;
+  U64 state_;
+  std::array<U32, 5> cumulative_{};
+  U8 sync_wait_{};
+  U64 num_cycles_{};
+  std::vector<U8> cycle_;
+};
+
+// Writes clocks to the six channels of a simulation. Channel is
+// SimulationChannelDescriptor or anything shaped like it. Every channel starts
+// high at sample 0; LCLK falls half a period later and LAD/LFRAMEn change one
+// sample after each rising edge. Channels are only advanced when they toggle,
+// so idle stretches are cheap.
+template <typename Channel>
+class LpcSimulationWriter {
+ public:
+  // channels are LAD[0..3], LFRAMEn, LCLK; LCLK may be null
+  LpcSimulationWriter(const std::array<Channel*, 6>& channels, U64 sample_rate)
+      : channels_(channels) {
+    // half an LCLK period is sample_rate * 3 / 200 MHz samples
+    const U64 num = sample_rate * kLclkHzDen;
+    step_ = num / kHalfDen;
+    step_frac_ = num % kHalfDen;
+    data_delay_ = step_ >= 2 ? 1 : 0;
+  }
+
+  void Write(const U8* bits, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+      const U64 rise = NextEdge();
+      // the first clock starts with LCLK already high
+      if (started_) {
+        Toggle(kLclk, rise);
+      }
+      started_ = true;
+      U8 changed = bits[i] ^ level_;
+      level_ = bits[i];
+      for (size_t c = 0; changed != 0; c++, changed >>= 1) {
+        if (changed & 1) {
+          Toggle(c, rise + data_delay_);
+        }
+      }
+      Toggle(kLclk, NextEdge());
+    }
+  }
+  void Write(const std::vector<U8>& bits) { Write(bits.data(), bits.size()); }
+
+  // sample of the rising edge the next clock starts with
+  U64 sample() const { return edge_; }
+
+ private:
+  static constexpr size_t kLclk = 5;
+  static constexpr U64 kHalfDen = 2 * kLclkHzNum;
+
+  U64 NextEdge() {
+    const U64 edge = edge_;
+    edge_ += step_;
+    frac_ += step_frac_;
+    if (frac_ >= kHalfDen) {
+      frac_ -= kHalfDen;
+      edge_++;
+    }
+    return edge;
+  }
+  void Toggle(size_t c, U64 sample) {
+    if (channels_[c] == nullptr) {
+      return;
+    }
+    U64 n = sample - at_[c];
+    // Advance() takes 32 bits
+    for (; n > std::numeric_limits<U32>::max();
+         n -= std::numeric_limits<U32>::max()) {
+      channels_[c]->Advance(std::numeric_limits<U32>::max());
+    }
+    channels_[c]->Advance((U32)n);
+    channels_[c]->Transition();
+    at_[c] = sample;
+  }
+
+  std::array<Channel*, 6> channels_;
+  // sample each channel was last advanced to
+  std::array<U64, 6> at_{};
+  U64 edge_{};
+  U64 frac_{};
+  U64 step_{};
+  U64 step_frac_{};
+  U64 data_delay_{};
+  U8 level_{kLADMask | kLFRAMEnBit};
+  bool started_{};
+};
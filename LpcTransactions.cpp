@@ -0,0 +1,143 @@
+#include "LpcTransactions.h"
+
+void LpcTransactionTable::clear() {
+  start.clear();
+  end.clear();
+  first_frame.clear();
+  num_frames.clear();
+  address.clear();
+  data.clear();
+  sync_waits.clear();
+  start_code.clear();
+  cyctype.clear();
+  data_bytes.clear();
+  sync.clear();
+  flags.clear();
+  has_address.clear();
+  long_data.clear();
+}
+
+void LpcTransactionTable::reserve(size_t n) {
+  start.reserve(n);
+  end.reserve(n);
+  first_frame.reserve(n);
+  num_frames.reserve(n);
+  address.reserve(n);
+  data.reserve(n);
+  sync_waits.reserve(n);
+  start_code.reserve(n);
+  cyctype.reserve(n);
+  data_bytes.reserve(n);
+  sync.reserve(n);
+  flags.reserve(n);
+  has_address.reserve(n);
+}
+
+LpcTransaction SummarizeCycle(const LpcCycle& cycle,
+                              const LpcFrame* frames,
+                              U64 first_frame) {
+  U32 addr = 0;
+  U32 value = 0;
+  U16 waits = 0;
+  U8 type = LpcTransaction::kNone;
+  U8 bytes = 0;
+  U8 final_sync = LpcTransaction::kNone;
+  bool addressed = false;
+  for (U32 i = 0; i < cycle.num_frames; i++) {
+    const LpcFrame& f = frames[i];
+    switch (f.type) {
+    case kCYCTYPE_DIR:
+      type = (U8)f.data1;
+      break;
+    case kADDR:
+      addr = (U32)f.data1;
+      addressed = true;
+      break;
+    case kDATA:
+      if (bytes < 4) {
+        value |= (U32)(U8)f.data1 << (bytes * 8);
+      }
+      if (bytes < 0xff) {
+        bytes++;
+      }
+      break;
+    case kSYNC:
+      if (f.data1 == kShortWait || f.data1 == kLongWait) {
+        if (waits < 0xffff) {
+          waits++;
+        }
+      } else {
+        final_sync = (U8)f.data1;
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  return {cycle.start, cycle.end, first_frame, cycle.num_frames,
+          addr,        value,     waits,       cycle.start_code,
+          type,        bytes,     final_sync,  cycle.flags,
+          addressed};
+}
+
+LpcFrame CycleFrame(const LpcTransaction& t) {
+  return {t.start,
+          t.end,
+          t.address | (U64)t.start_code << 32 | (U64)t.has_address << 40 |
+              (U64)t.data_bytes << 48,
+          t.data | (U64)t.sync_waits << 32 | (U64)t.cyctype << 48 |
+              (U64)t.sync << 56,
+          kCYCLE,
+          t.flags};
+}
+
+LpcTransaction CycleFrameTransaction(const LpcFrame& frame) {
+  return {frame.start,
+          frame.end,
+          0,
+          0,
+          (U32)frame.data1,
+          (U32)frame.data2,
+          (U16)(frame.data2 >> 32),
+          (U8)(frame.data1 >> 32),
+          (U8)(frame.data2 >> 48),
+          (U8)(frame.data1 >> 48),
+          (U8)(frame.data2 >> 56),
+          frame.flags,
+          (frame.data1 >> 40 & 1) != 0};
+}
+
+void LpcTransactionTable::Append(const LpcCycle& cycle,
+                                 const LpcFrame* frames,
+                                 U64 first) {
+  const LpcTransaction t = SummarizeCycle(cycle, frames, first);
+  start.push_back(t.start);
+  end.push_back(t.end);
+  first_frame.push_back(t.first_frame);
+  num_frames.push_back(t.num_frames);
+  address.push_back(t.address);
+  data.push_back(t.data);
+  sync_waits.push_back(t.sync_waits);
+  start_code.push_back(t.start_code);
+  cyctype.push_back(t.cyctype);
+  data_bytes.push_back(t.data_bytes);
+  sync.push_back(t.sync);
+  flags.push_back(t.flags);
+  has_address.push_back(t.has_address);
+  if (t.data_bytes > 4) {
+    U8 bytes = 0;
+    for (U32 i = 0; i < cycle.num_frames && bytes < t.data_bytes; i++) {
+      if (frames[i].type == kDATA) {
+        long_data.push_back((U8)frames[i].data1);
+        bytes++;
+      }
+    }
+  }
+}
+
+LpcTransaction LpcTransactionTable::operator[](size_t i) const {
+  return {start[i],      end[i],        first_frame[i], num_frames[i],
+          address[i],    data[i],       sync_waits[i],  start_code[i],
+          cyctype[i],    data_bytes[i], sync[i],        flags[i],
+          has_address[i] != 0};
+}
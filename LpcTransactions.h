@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include "LpcDecoder.h"
+
+// One cycle, summarized from its frames.
+struct LpcTransaction {
+  static constexpr U8 kNone = 0xff;
+
+  U64 start;
+  U64 end;
+  // index of the cycle's first frame, and how many it has
+  U64 first_frame;
+  U32 num_frames;
+  U32 address;
+  // first (up to) 4 bytes, little endian
+  U32 data;
+  U16 sync_waits;
+  U8 start_code;
+  // CYCTYPE_DIR, kNone for cycles without one (FW, Stop, aborted early)
+  U8 cyctype;
+  // number of DATA bytes, data holds only the first 4
+  U8 data_bytes;
+  // final SYNC value, kNone if the cycle didn't get that far
+  U8 sync;
+  // LpcCycleFlags
+  U8 flags;
+  bool has_address;
+};
+
+// |frames| are the cycle's frames, the first of which is frame |first_frame|
+// overall.
+LpcTransaction SummarizeCycle(const LpcCycle& cycle,
+                              const LpcFrame* frames,
+                              U64 first_frame);
+
+// A kCYCLE frame stands for a whole cycle, in place of its per-field frames.
+// The frame indices aren't kept.
+//   data1: address | start_code << 32 | has_address << 40 | data_bytes << 48
+//   data2: data | sync_waits << 32 | cyctype << 48 | sync << 56
+//   flags: LpcCycleFlags
+LpcFrame CycleFrame(const LpcTransaction& t);
+LpcTransaction CycleFrameTransaction(const LpcFrame& frame);
+
+// Completed cycles, appended as they are committed. Stored column by column:
+// exports and lookups touch a few fields of many transactions, and columns
+// can be written out as they are.
+class LpcTransactionTable {
+ public:
+  size_t size() const { return start.size(); }
+  void clear();
+  void reserve(size_t n);
+  // |frames| are the cycle's frames, the first of which is frame
+  // |first_frame| overall.
+  void Append(const LpcCycle& cycle, const LpcFrame* frames, U64 first_frame);
+  LpcTransaction operator[](size_t i) const;
+
+  std::vector<U64> start;
+  std::vector<U64> end;
+  std::vector<U64> first_frame;
+  std::vector<U32> num_frames;
+  std::vector<U32> address;
+  std::vector<U32> data;
+  std::vector<U16> sync_waits;
+  std::vector<U8> start_code;
+  std::vector<U8> cyctype;
+  std::vector<U8> data_bytes;
+  std::vector<U8> sync;
+  std::vector<U8> flags;
+  std::vector<U8> has_address;
+  // All the DATA bytes of transactions with more than 4, one after the
+  // other, in order. data has the first 4 of the rest.
+  std::vector<U8> long_data;
+};